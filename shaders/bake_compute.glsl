@@ -0,0 +1,29 @@
+// Compute shader main for a bake kernel, which must be included first and
+// define bool bake(vec3 dir, out vec3 color). Each invocation bakes one
+// texel of one face, z being the face.
+
+#include "bake_push_constants.glsl"
+#include "cube_face.glsl"
+
+// Workgroup size, set by the baker through specialization constants
+layout(local_size_x_id = 0, local_size_y_id = 1, local_size_z = 1) in;
+
+// The mip level being baked, as a six layer array
+layout(set = 0, binding = 1, rgba32f) uniform writeonly image2DArray dest;
+
+void main() {
+  ivec3 texel = ivec3(gl_GlobalInvocationID);
+  ivec2 size = imageSize(dest).xy;
+  if (any(greaterThanEqual(texel.xy, size)) ||
+      (pc.skip_faces & (1u << uint(texel.z))) != 0u) {
+    return;
+  }
+
+  vec2 ndc = (vec2(texel.xy) + 0.5) / vec2(size) * 2.0 - 1.0;
+  vec3 dir = normalize(cube_face_direction(uint(texel.z), ndc));
+
+  vec3 color;
+  if (bake(dir, color)) {
+    imageStore(dest, texel, vec4(color, 1.0));
+  }
+}
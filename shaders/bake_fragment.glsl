@@ -0,0 +1,24 @@
+// Fragment shader main for a bake kernel, which must be included first and
+// define bool bake(vec3 dir, out vec3 color)
+
+#include "bake_push_constants.glsl"
+#include "cube_face.glsl"
+
+// Interpolated at the texel center, which gives the same direction the
+// compute backend bakes
+layout(location = 0) in vec2 face_ndc;
+layout(location = 1) flat in uint face;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+  if ((pc.skip_faces & (1u << face)) != 0u) {
+    discard;
+  }
+
+  vec3 color;
+  if (!bake(normalize(cube_face_direction(face, face_ndc)), color)) {
+    discard;
+  }
+  out_color = vec4(color, 1.0);
+}
@@ -0,0 +1,21 @@
+#ifndef BAKE_PUSH_CONSTANTS_GLSL
+#define BAKE_PUSH_CONSTANTS_GLSL
+
+layout(push_constant) uniform PushConstant {
+  float roughness;
+  // Level of the source cubemap a bake reads
+  uint source_level;
+  // Samples per texel, for stages that take a variable number, and where
+  // the samples of the level start in the sample table
+  uint sample_count;
+  uint sample_offset;
+  // Part of the panorama covered by the bound tile, in uv space
+  vec4 tile_rect;
+  // Scale and offset from panorama uv to tile uv
+  vec4 tile_transform;
+  // Bit per face the bake leaves alone, for stages that finish some faces
+  // before others
+  uint skip_faces;
+} pc;
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef CUBE_FACE_GLSL
+#define CUBE_FACE_GLSL
+
+// Direction through a point of a cube face, for faces in layer order +X, -X,
+// +Y, -Y, +Z, -Z. ndc goes from -1 to 1 across the face, x to the right and
+// y down. cube_face_direction in main.c is the same on the CPU.
+vec3 cube_face_direction(uint face, vec2 ndc) {
+  switch (face) {
+  case 0u:
+    return vec3(1.0, -ndc.y, -ndc.x);
+  case 1u:
+    return vec3(-1.0, -ndc.y, ndc.x);
+  case 2u:
+    return vec3(ndc.x, 1.0, ndc.y);
+  case 3u:
+    return vec3(ndc.x, -1.0, -ndc.y);
+  case 4u:
+    return vec3(ndc.x, -ndc.y, 1.0);
+  default:
+    return vec3(-ndc.x, -ndc.y, -1.0);
+  }
+}
+
+#endif
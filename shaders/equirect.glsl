@@ -0,0 +1,29 @@
+#ifndef EQUIRECT_GLSL
+#define EQUIRECT_GLSL
+
+#include "bake_push_constants.glsl"
+
+const vec2 inv_atan = vec2(0.1591, 0.3183);
+
+vec2 sample_spherical_map(vec3 v) {
+  vec2 uv = vec2(atan(v.z, v.x), asin(v.y));
+  uv *= inv_atan;
+  uv += 0.5;
+  return uv;
+}
+
+// Large panoramas are rendered one tile at a time. Gives the uv of dir in
+// the bound tile image, or false if another tile covers dir.
+bool equirect_tile_uv(vec3 dir, out vec2 uv) {
+  uv = sample_spherical_map(dir);
+  uv.y = 1.0 - uv.y;
+
+  if (any(lessThan(uv, pc.tile_rect.xy)) ||
+      any(greaterThanEqual(uv, pc.tile_rect.zw))) {
+    return false;
+  }
+  uv = uv * pc.tile_transform.xy + pc.tile_transform.zw;
+  return true;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#version 450
+
+// One triangle covering the whole viewport, drawn with 3 vertices and no
+// vertex buffer. cube_faces.geom sends it to every face.
+layout(location = 0) out vec2 ndc;
+
+void main() {
+  ndc = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+  gl_Position = vec4(ndc, 0.0, 1.0);
+}
@@ -0,0 +1,35 @@
+#include "bake_push_constants.glsl"
+
+layout(set = 0, binding = 0) uniform samplerCube skybox;
+
+// Every texel of the source level: unit direction to its center, and its
+// solid angle in w
+layout(std430, set = 0, binding = 2) readonly buffer IrradianceSamples {
+  vec4 samples[];
+};
+
+const float PI = 3.14159265359;
+
+// Sums every texel of a small skybox level, weighted by its solid angle and
+// the cosine to N. Gives irradiance divided by pi.
+bool bake(vec3 dir, out vec3 color) {
+  vec3 N = dir;
+  vec3 irradiance = vec3(0.0);
+
+  float lod = float(pc.source_level);
+
+  for (int i = 0; i < samples.length(); i++) {
+    vec4 s = samples[i];
+
+    float NdotL = dot(N, s.xyz);
+    if (NdotL <= 0.0) {
+      continue;
+    }
+
+    // Texel centers sample a single texel, whatever the filter
+    irradiance += textureLod(skybox, s.xyz, lod).rgb * (NdotL * s.w);
+  }
+
+  color = irradiance / PI;
+  return true;
+}
@@ -0,0 +1,38 @@
+#include "bake_push_constants.glsl"
+
+layout(set = 0, binding = 0) uniform samplerCube skybox;
+
+// GGX samples of every level, made by create_radiance_samples in main.c.
+// Each is a direction in tangent space, N being z and so NdotL being z, and
+// the skybox level to read it from in w. The samples of the level being
+// baked start at pc.sample_offset.
+layout(std430, set = 0, binding = 2) readonly buffer RadianceSamples {
+  vec4 samples[];
+};
+
+bool bake(vec3 dir, out vec3 color) {
+  vec3 N = dir;
+
+  // The samples assume V equals R equals the normal, so the only thing
+  // left per texel is to rotate them around N
+  vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+  vec3 tangent = normalize(cross(up, N));
+  vec3 bitangent = cross(N, tangent);
+  mat3 tangent_to_world = mat3(tangent, bitangent, N);
+
+  vec3 prefiltered_color = vec3(0.0);
+  float total_weight = 0.0;
+
+  for (uint i = 0u; i < pc.sample_count; i++) {
+    vec4 s = samples[pc.sample_offset + i];
+
+    vec3 L = tangent_to_world * s.xyz;
+    float NdotL = s.z;
+
+    prefiltered_color += textureLod(skybox, L, s.w).rgb * NdotL;
+    total_weight += NdotL;
+  }
+
+  color = prefiltered_color / total_weight;
+  return true;
+}
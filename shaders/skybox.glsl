@@ -0,0 +1,12 @@
+#include "equirect.glsl"
+
+layout(set = 0, binding = 0) uniform sampler2D equirectangular_map;
+
+bool bake(vec3 dir, out vec3 color) {
+  vec2 uv;
+  if (!equirect_tile_uv(dir, uv)) {
+    return false;
+  }
+  color = textureLod(equirectangular_map, uv, 0.0).rgb;
+  return true;
+}
@@ -0,0 +1,5 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "skybox_rgbe.glsl"
+#include "bake_fragment.glsl"
@@ -0,0 +1,44 @@
+#include "equirect.glsl"
+
+// Raw RGBE bytes of the equirectangular map, expanded to floats here
+layout(set = 0, binding = 0) uniform usampler2D equirectangular_map;
+
+// Same expansion as stb_image: rgb * 2^(e - 136), with e == 0 meaning black
+vec3 decode_rgbe(uvec4 rgbe) {
+  if (rgbe.a == 0u) {
+    return vec3(0.0);
+  }
+  return vec3(rgbe.rgb) * exp2(float(rgbe.a) - 136.0);
+}
+
+vec3 fetch_texel(ivec2 texel, ivec2 size) {
+  // Wrap around like VK_SAMPLER_ADDRESS_MODE_REPEAT. % is undefined for
+  // negative operands in GLSL, so this is a floor mod instead.
+  texel -= size * ivec2(floor(vec2(texel) / vec2(size)));
+  return decode_rgbe(texelFetch(equirectangular_map, texel, 0));
+}
+
+// Integer textures can't be filtered by the sampler, so do bilinear
+// filtering on the decoded values
+vec3 sample_bilinear(vec2 uv) {
+  ivec2 size = textureSize(equirectangular_map, 0);
+  vec2 pos = uv * vec2(size) - 0.5;
+  ivec2 base = ivec2(floor(pos));
+  vec2 f = pos - vec2(base);
+
+  vec3 c00 = fetch_texel(base, size);
+  vec3 c10 = fetch_texel(base + ivec2(1, 0), size);
+  vec3 c01 = fetch_texel(base + ivec2(0, 1), size);
+  vec3 c11 = fetch_texel(base + ivec2(1, 1), size);
+
+  return mix(mix(c00, c10, f.x), mix(c01, c11, f.x), f.y);
+}
+
+bool bake(vec3 dir, out vec3 color) {
+  vec2 uv;
+  if (!equirect_tile_uv(dir, uv)) {
+    return false;
+  }
+  color = sample_bilinear(uv);
+  return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Cubemap faces come in layer order +X, -X, +Y, -Y, +Z, -Z
+#define CUBE_FACE_COUNT 6
+
+// Direction through a point of a cube face. x and y go from -1 to 1 across
+// the face, x to the right and y down. Same as cube_face_direction in
+// shaders/cube_face.glsl, so the CPU and both bake backends agree on texel
+// directions.
+static inline void
+cube_face_direction(uint32_t face, float x, float y, float direction[3]) {
+  const float face_directions[CUBE_FACE_COUNT][3] = {
+      {1.0f, -y, -x},
+      {-1.0f, -y, x},
+      {x, 1.0f, y},
+      {x, -1.0f, -y},
+      {x, -y, 1.0f},
+      {-x, -y, -1.0f},
+  };
+
+  memcpy(direction, face_directions[face], sizeof(face_directions[face]));
+}
+
+// Unnormalized direction through the center of texel (x, y) of a face
+static inline void cube_texel_direction(
+    uint32_t face, uint32_t size, uint32_t x, uint32_t y, float direction[3]) {
+  cube_face_direction(
+      face,
+      ((float)x + 0.5f) / (float)size * 2.0f - 1.0f,
+      ((float)y + 0.5f) / (float)size * 2.0f - 1.0f,
+      direction);
+}
@@ -1,10 +1,18 @@
 #include <stb_image.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define ENV_MAX_RADIANCE_MIPMAPS 12
 
+// Order 2 spherical harmonics, see sh.h for the basis order
+#define ENV_SH_COEFFICIENT_COUNT 9
+
+// "SH9I" in little endian, starting the optional chunk after the radiance
+// layers. Files without it end with the layers.
+#define ENV_SH_CHUNK_MAGIC 0x49394853u
+
 typedef struct env_save_bundle_t {
   unsigned char *data;
   size_t cap;
@@ -18,6 +26,15 @@ typedef struct env_file_header_t {
   uint32_t radiance_mip_count;
 } env_file_header_t;
 
+typedef struct env_file_sh_chunk_t {
+  uint32_t magic;
+
+  // RGB spherical harmonics of the irradiance, already convolved and divided
+  // by pi like the irradiance cubemap. Evaluating them in a normal gives the
+  // diffuse lighting there.
+  float sh_irradiance[ENV_SH_COEFFICIENT_COUNT][3];
+} env_file_sh_chunk_t;
+
 typedef struct env_file_read_options_t {
   uint32_t skybox_dim;
   float *skybox_layers[6];
@@ -26,6 +43,8 @@ typedef struct env_file_read_options_t {
   uint32_t base_radiance_dim;
   float *radiance_layers[ENV_MAX_RADIANCE_MIPMAPS][6];
   uint32_t radiance_mip_count;
+  bool has_sh_irradiance;
+  float sh_irradiance[ENV_SH_COEFFICIENT_COUNT][3];
   const char *path;
 } env_file_read_options_t;
 
@@ -86,5 +105,18 @@ static inline void env_file_read(env_file_read_options_t *options) {
     }
   }
 
+  options->has_sh_irradiance = false;
+  env_file_sh_chunk_t sh_chunk;
+  if (current_pos + sizeof(sh_chunk) <= data_size) {
+    memcpy(&sh_chunk, &data[current_pos], sizeof(sh_chunk));
+    if (sh_chunk.magic == ENV_SH_CHUNK_MAGIC) {
+      options->has_sh_irradiance = true;
+      memcpy(
+          options->sh_irradiance,
+          sh_chunk.sh_irradiance,
+          sizeof(options->sh_irradiance));
+    }
+  }
+
   free(data);
 }
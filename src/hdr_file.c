@@ -0,0 +1,1357 @@
+// For pread
+#define _XOPEN_SOURCE 700
+
+#include "hdr_file.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HDR_FILE_X86
+#include <immintrin.h>
+#endif
+
+/*
+ *
+ * Pixel conversion kernels
+ *
+ */
+
+// Scanlines are decoded into planar form: the R, G, B and E bytes of a row
+// are stored one after another, each plane being `width` bytes long. The
+// kernels turn one such row into a row of the output pixel format.
+typedef void (*convert_planar_rgbe_fn)(
+    const unsigned char *planes, uint32_t width, void *out);
+
+// 2^(e - 136) for every exponent, with 0 for e == 0. This is the factor
+// stbi__hdr_convert computes with ldexp for each pixel.
+static float g_rgbe_scales[256];
+
+static convert_planar_rgbe_fn g_convert_planar_rgbe[HDR_PIXEL_FORMAT_COUNT];
+
+// Packs RGBA32F pixels into a smaller float format. There is no kernel for
+// RGBE8, which only ever comes straight from the file.
+typedef void (*pack_rgba32f_fn)(const float *src, size_t count, void *out);
+
+static pack_rgba32f_fn g_pack_rgba32f[HDR_PIXEL_FORMAT_COUNT];
+
+#define HDR_HALF_ONE 0x3c00
+
+static void convert_planar_rgbe_scalar(
+    const unsigned char *planes, uint32_t width, void *out) {
+  float *pixels = out;
+  const unsigned char *r = planes;
+  const unsigned char *g = planes + width;
+  const unsigned char *b = planes + width * 2;
+  const unsigned char *e = planes + width * 3;
+
+  for (uint32_t i = 0; i < width; i++) {
+    float scale = g_rgbe_scales[e[i]];
+    pixels[i * 4 + 0] = (float)r[i] * scale;
+    pixels[i * 4 + 1] = (float)g[i] * scale;
+    pixels[i * 4 + 2] = (float)b[i] * scale;
+    pixels[i * 4 + 3] = 1.0f;
+  }
+}
+
+// RGBE8 output just puts the planes back in RGBE pixel order
+static void interleave_planar_rgbe_scalar(
+    const unsigned char *planes, uint32_t width, void *out) {
+  unsigned char *rgbe = out;
+
+  for (uint32_t i = 0; i < width; i++) {
+    rgbe[i * 4 + 0] = planes[i];
+    rgbe[i * 4 + 1] = planes[width + i];
+    rgbe[i * 4 + 2] = planes[width * 2 + i];
+    rgbe[i * 4 + 3] = planes[width * 3 + i];
+  }
+}
+
+// Rounds to the nearest half float. Values too large for a half are clamped
+// to the largest finite one, 65504, instead of becoming infinities.
+static uint16_t float_to_half(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+  bits &= 0x7fffffff;
+
+  if (bits > 0x7f800000) {
+    return sign | 0x7e00; // NaN
+  }
+  if (bits >= 0x477fe000) {
+    return sign | 0x7bff; // 65504
+  }
+  if (bits < 0x38800000) {
+    // Subnormal half, in units of 2^-24
+    float magnitude;
+    memcpy(&magnitude, &bits, sizeof(magnitude));
+    return sign | (uint16_t)lrintf(magnitude * 16777216.0f);
+  }
+
+  // Rebias the exponent from 127 to 15 and round the mantissa from 23 to 10
+  // bits, to nearest even
+  bits -= 0x38000000;
+  return sign | (uint16_t)((bits + 0xfff + ((bits >> 13) & 1)) >> 13);
+}
+
+// Drops the low mantissa bits of a non-negative half, rounding to nearest
+// even. The 11 and 10 bit floats of B10G11R11 share the exponent bias of
+// halves, so this is all the conversion takes.
+static inline uint32_t half_to_small_float(uint16_t half, uint32_t shift) {
+  uint32_t max = 0x7bffu >> shift; // Largest finite value
+  uint32_t bits =
+      ((uint32_t)half + (1u << (shift - 1)) - 1 + ((half >> shift) & 1)) >>
+      shift;
+  return bits < max ? bits : max;
+}
+
+// Packs into B10G11R11_UFLOAT, which has no sign, so negatives become 0
+static uint32_t float_to_b10g11r11(float r, float g, float b) {
+  uint32_t r11 = half_to_small_float(float_to_half(fmaxf(r, 0.0f)), 4);
+  uint32_t g11 = half_to_small_float(float_to_half(fmaxf(g, 0.0f)), 4);
+  uint32_t b10 = half_to_small_float(float_to_half(fmaxf(b, 0.0f)), 5);
+  return r11 | (g11 << 11) | (b10 << 22);
+}
+
+static void convert_planar_rgbe_rgba16f_scalar(
+    const unsigned char *planes, uint32_t width, void *out) {
+  uint16_t *pixels = out;
+  const unsigned char *r = planes;
+  const unsigned char *g = planes + width;
+  const unsigned char *b = planes + width * 2;
+  const unsigned char *e = planes + width * 3;
+
+  for (uint32_t i = 0; i < width; i++) {
+    float scale = g_rgbe_scales[e[i]];
+    pixels[i * 4 + 0] = float_to_half((float)r[i] * scale);
+    pixels[i * 4 + 1] = float_to_half((float)g[i] * scale);
+    pixels[i * 4 + 2] = float_to_half((float)b[i] * scale);
+    pixels[i * 4 + 3] = HDR_HALF_ONE;
+  }
+}
+
+static void convert_planar_rgbe_b10g11r11_scalar(
+    const unsigned char *planes, uint32_t width, void *out) {
+  uint32_t *pixels = out;
+  const unsigned char *r = planes;
+  const unsigned char *g = planes + width;
+  const unsigned char *b = planes + width * 2;
+  const unsigned char *e = planes + width * 3;
+
+  for (uint32_t i = 0; i < width; i++) {
+    float scale = g_rgbe_scales[e[i]];
+    pixels[i] = float_to_b10g11r11(
+        (float)r[i] * scale, (float)g[i] * scale, (float)b[i] * scale);
+  }
+}
+
+static void pack_rgba32f_copy(const float *src, size_t count, void *out) {
+  memcpy(out, src, count * 4 * sizeof(float));
+}
+
+static void
+pack_rgba32f_rgba16f_scalar(const float *src, size_t count, void *out) {
+  uint16_t *pixels = out;
+  for (size_t i = 0; i < count * 4; i++) {
+    pixels[i] = float_to_half(src[i]);
+  }
+}
+
+static void
+pack_rgba32f_b10g11r11_scalar(const float *src, size_t count, void *out) {
+  uint32_t *pixels = out;
+  for (size_t i = 0; i < count; i++) {
+    pixels[i] = float_to_b10g11r11(src[i * 4], src[i * 4 + 1], src[i * 4 + 2]);
+  }
+}
+
+#ifdef HDR_FILE_X86
+static inline uint32_t load_u32(const unsigned char *bytes) {
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+__attribute__((target("sse2"))) static inline __m128
+u8x4_to_ps(const unsigned char *bytes) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i v = _mm_cvtsi32_si128((int)load_u32(bytes));
+  v = _mm_unpacklo_epi8(v, zero);
+  v = _mm_unpacklo_epi16(v, zero);
+  return _mm_cvtepi32_ps(v);
+}
+
+__attribute__((target("sse2"))) static void convert_planar_rgbe_sse2(
+    const unsigned char *planes, uint32_t width, void *out) {
+  float *pixels = out;
+  const unsigned char *r = planes;
+  const unsigned char *g = planes + width;
+  const unsigned char *b = planes + width * 2;
+  const unsigned char *e = planes + width * 3;
+
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  uint32_t i = 0;
+  for (; i + 4 <= width; i += 4) {
+    __m128 scale = _mm_setr_ps(
+        g_rgbe_scales[e[i + 0]],
+        g_rgbe_scales[e[i + 1]],
+        g_rgbe_scales[e[i + 2]],
+        g_rgbe_scales[e[i + 3]]);
+
+    __m128 vr = _mm_mul_ps(u8x4_to_ps(&r[i]), scale);
+    __m128 vg = _mm_mul_ps(u8x4_to_ps(&g[i]), scale);
+    __m128 vb = _mm_mul_ps(u8x4_to_ps(&b[i]), scale);
+    __m128 va = one;
+
+    // Turns the four channel vectors into four RGBA pixels
+    _MM_TRANSPOSE4_PS(vr, vg, vb, va);
+
+    _mm_storeu_ps(&pixels[(i + 0) * 4], vr);
+    _mm_storeu_ps(&pixels[(i + 1) * 4], vg);
+    _mm_storeu_ps(&pixels[(i + 2) * 4], vb);
+    _mm_storeu_ps(&pixels[(i + 3) * 4], va);
+  }
+
+  for (; i < width; i++) {
+    float scale = g_rgbe_scales[e[i]];
+    pixels[i * 4 + 0] = (float)r[i] * scale;
+    pixels[i * 4 + 1] = (float)g[i] * scale;
+    pixels[i * 4 + 2] = (float)b[i] * scale;
+    pixels[i * 4 + 3] = 1.0f;
+  }
+}
+
+__attribute__((target("sse2"))) static void interleave_planar_rgbe_sse2(
+    const unsigned char *planes, uint32_t width, void *out) {
+  const unsigned char *r = planes;
+  const unsigned char *g = planes + width;
+  const unsigned char *b = planes + width * 2;
+  const unsigned char *e = planes + width * 3;
+  unsigned char *rgbe = out;
+
+  uint32_t i = 0;
+  for (; i + 16 <= width; i += 16) {
+    __m128i vr = _mm_loadu_si128((const __m128i *)&r[i]);
+    __m128i vg = _mm_loadu_si128((const __m128i *)&g[i]);
+    __m128i vb = _mm_loadu_si128((const __m128i *)&b[i]);
+    __m128i ve = _mm_loadu_si128((const __m128i *)&e[i]);
+
+    __m128i rg_lo = _mm_unpacklo_epi8(vr, vg);
+    __m128i rg_hi = _mm_unpackhi_epi8(vr, vg);
+    __m128i be_lo = _mm_unpacklo_epi8(vb, ve);
+    __m128i be_hi = _mm_unpackhi_epi8(vb, ve);
+
+    __m128i *dst = (__m128i *)&rgbe[i * 4];
+    _mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(rg_lo, be_lo));
+    _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(rg_lo, be_lo));
+    _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(rg_hi, be_hi));
+    _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(rg_hi, be_hi));
+  }
+
+  for (; i < width; i++) {
+    rgbe[i * 4 + 0] = r[i];
+    rgbe[i * 4 + 1] = g[i];
+    rgbe[i * 4 + 2] = b[i];
+    rgbe[i * 4 + 3] = e[i];
+  }
+}
+
+__attribute__((target("avx2"))) static inline __m256
+u8x8_to_ps(const unsigned char *bytes) {
+  __m128i v = _mm_loadl_epi64((const __m128i *)bytes);
+  return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+}
+
+__attribute__((target("avx2"))) static void convert_planar_rgbe_avx2(
+    const unsigned char *planes, uint32_t width, void *out) {
+  float *pixels = out;
+  const unsigned char *r = planes;
+  const unsigned char *g = planes + width;
+  const unsigned char *b = planes + width * 2;
+  const unsigned char *e = planes + width * 3;
+
+  const __m256 one = _mm256_set1_ps(1.0f);
+
+  uint32_t i = 0;
+  for (; i + 8 <= width; i += 8) {
+    __m256i exponents =
+        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&e[i]));
+    __m256 scale = _mm256_i32gather_ps(g_rgbe_scales, exponents, 4);
+
+    __m256 vr = _mm256_mul_ps(u8x8_to_ps(&r[i]), scale);
+    __m256 vg = _mm256_mul_ps(u8x8_to_ps(&g[i]), scale);
+    __m256 vb = _mm256_mul_ps(u8x8_to_ps(&b[i]), scale);
+
+    // 4x4 transpose inside each 128-bit lane...
+    __m256 rg_lo = _mm256_unpacklo_ps(vr, vg);
+    __m256 rg_hi = _mm256_unpackhi_ps(vr, vg);
+    __m256 ba_lo = _mm256_unpacklo_ps(vb, one);
+    __m256 ba_hi = _mm256_unpackhi_ps(vb, one);
+
+    __m256 p04 = _mm256_shuffle_ps(rg_lo, ba_lo, 0x44);
+    __m256 p15 = _mm256_shuffle_ps(rg_lo, ba_lo, 0xEE);
+    __m256 p26 = _mm256_shuffle_ps(rg_hi, ba_hi, 0x44);
+    __m256 p37 = _mm256_shuffle_ps(rg_hi, ba_hi, 0xEE);
+
+    // ...then put the lanes back in pixel order
+    float *dst = &pixels[i * 4];
+    _mm256_storeu_ps(dst + 0, _mm256_permute2f128_ps(p04, p15, 0x20));
+    _mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(p26, p37, 0x20));
+    _mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(p04, p15, 0x31));
+    _mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(p26, p37, 0x31));
+  }
+
+  for (; i < width; i++) {
+    float scale = g_rgbe_scales[e[i]];
+    pixels[i * 4 + 0] = (float)r[i] * scale;
+    pixels[i * 4 + 1] = (float)g[i] * scale;
+    pixels[i * 4 + 2] = (float)b[i] * scale;
+    pixels[i * 4 + 3] = 1.0f;
+  }
+}
+// Converts four floats to halves, clamped to +-65504 since F16C turns larger
+// values into infinities
+__attribute__((target("sse4.1,f16c"))) static inline __m128i
+ps_to_ph(__m128 v) {
+  v = _mm_min_ps(v, _mm_set1_ps(65504.0f));
+  v = _mm_max_ps(v, _mm_set1_ps(-65504.0f));
+  return _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+}
+
+// Interleaves four pixels worth of channel vectors into RGBA16F
+__attribute__((target("sse4.1,f16c"))) static inline void
+store_rgba16f_x4(__m128 vr, __m128 vg, __m128 vb, uint16_t *out) {
+  __m128i rg = _mm_unpacklo_epi16(ps_to_ph(vr), ps_to_ph(vg));
+  __m128i ba = _mm_unpacklo_epi16(ps_to_ph(vb), _mm_set1_epi16(HDR_HALF_ONE));
+  _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi32(rg, ba));
+  _mm_storeu_si128((__m128i *)(out + 8), _mm_unpackhi_epi32(rg, ba));
+}
+
+// Vector version of half_to_small_float for four non-negative floats
+__attribute__((target("sse4.1,f16c"))) static inline __m128i
+ps_to_small_float(__m128 v, int shift) {
+  __m128i half = _mm_cvtepu16_epi32(ps_to_ph(_mm_max_ps(v, _mm_setzero_ps())));
+  __m128i odd =
+      _mm_and_si128(_mm_srli_epi32(half, shift), _mm_set1_epi32(1));
+  __m128i bias = _mm_add_epi32(_mm_set1_epi32((1 << (shift - 1)) - 1), odd);
+  __m128i bits = _mm_srli_epi32(_mm_add_epi32(half, bias), shift);
+  return _mm_min_epi32(bits, _mm_set1_epi32(0x7bff >> shift));
+}
+
+__attribute__((target("sse4.1,f16c"))) static inline __m128i
+b10g11r11_x4(__m128 vr, __m128 vg, __m128 vb) {
+  __m128i r11 = ps_to_small_float(vr, 4);
+  __m128i g11 = ps_to_small_float(vg, 4);
+  __m128i b10 = ps_to_small_float(vb, 5);
+  return _mm_or_si128(
+      _mm_or_si128(r11, _mm_slli_epi32(g11, 11)), _mm_slli_epi32(b10, 22));
+}
+
+__attribute__((target("sse4.1,f16c"))) static void
+convert_planar_rgbe_rgba16f_f16c(
+    const unsigned char *planes, uint32_t width, void *out) {
+  uint16_t *pixels = out;
+  const unsigned char *r = planes;
+  const unsigned char *g = planes + width;
+  const unsigned char *b = planes + width * 2;
+  const unsigned char *e = planes + width * 3;
+
+  uint32_t i = 0;
+  for (; i + 4 <= width; i += 4) {
+    __m128 scale = _mm_setr_ps(
+        g_rgbe_scales[e[i + 0]],
+        g_rgbe_scales[e[i + 1]],
+        g_rgbe_scales[e[i + 2]],
+        g_rgbe_scales[e[i + 3]]);
+
+    store_rgba16f_x4(
+        _mm_mul_ps(u8x4_to_ps(&r[i]), scale),
+        _mm_mul_ps(u8x4_to_ps(&g[i]), scale),
+        _mm_mul_ps(u8x4_to_ps(&b[i]), scale),
+        &pixels[i * 4]);
+  }
+
+  for (; i < width; i++) {
+    float scale = g_rgbe_scales[e[i]];
+    pixels[i * 4 + 0] = float_to_half((float)r[i] * scale);
+    pixels[i * 4 + 1] = float_to_half((float)g[i] * scale);
+    pixels[i * 4 + 2] = float_to_half((float)b[i] * scale);
+    pixels[i * 4 + 3] = HDR_HALF_ONE;
+  }
+}
+
+__attribute__((target("sse4.1,f16c"))) static void
+convert_planar_rgbe_b10g11r11_f16c(
+    const unsigned char *planes, uint32_t width, void *out) {
+  uint32_t *pixels = out;
+  const unsigned char *r = planes;
+  const unsigned char *g = planes + width;
+  const unsigned char *b = planes + width * 2;
+  const unsigned char *e = planes + width * 3;
+
+  uint32_t i = 0;
+  for (; i + 4 <= width; i += 4) {
+    __m128 scale = _mm_setr_ps(
+        g_rgbe_scales[e[i + 0]],
+        g_rgbe_scales[e[i + 1]],
+        g_rgbe_scales[e[i + 2]],
+        g_rgbe_scales[e[i + 3]]);
+
+    __m128i packed = b10g11r11_x4(
+        _mm_mul_ps(u8x4_to_ps(&r[i]), scale),
+        _mm_mul_ps(u8x4_to_ps(&g[i]), scale),
+        _mm_mul_ps(u8x4_to_ps(&b[i]), scale));
+    _mm_storeu_si128((__m128i *)&pixels[i], packed);
+  }
+
+  for (; i < width; i++) {
+    float scale = g_rgbe_scales[e[i]];
+    pixels[i] = float_to_b10g11r11(
+        (float)r[i] * scale, (float)g[i] * scale, (float)b[i] * scale);
+  }
+}
+
+__attribute__((target("sse4.1,f16c"))) static void
+pack_rgba32f_rgba16f_f16c(const float *src, size_t count, void *out) {
+  uint16_t *pixels = out;
+  for (size_t i = 0; i < count; i++) {
+    _mm_storel_epi64(
+        (__m128i *)&pixels[i * 4], ps_to_ph(_mm_loadu_ps(&src[i * 4])));
+  }
+}
+
+__attribute__((target("sse4.1,f16c"))) static void
+pack_rgba32f_b10g11r11_f16c(const float *src, size_t count, void *out) {
+  uint32_t *pixels = out;
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 vr = _mm_loadu_ps(&src[(i + 0) * 4]);
+    __m128 vg = _mm_loadu_ps(&src[(i + 1) * 4]);
+    __m128 vb = _mm_loadu_ps(&src[(i + 2) * 4]);
+    __m128 va = _mm_loadu_ps(&src[(i + 3) * 4]);
+
+    // Turns the four RGBA pixels into channel vectors
+    _MM_TRANSPOSE4_PS(vr, vg, vb, va);
+
+    _mm_storeu_si128((__m128i *)&pixels[i], b10g11r11_x4(vr, vg, vb));
+  }
+
+  for (; i < count; i++) {
+    pixels[i] = float_to_b10g11r11(src[i * 4], src[i * 4 + 1], src[i * 4 + 2]);
+  }
+}
+#endif
+
+static void init_convert_kernels() {
+  if (g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBA32F] != NULL) {
+    return;
+  }
+
+  g_rgbe_scales[0] = 0.0f;
+  for (int e = 1; e < 256; e++) {
+    g_rgbe_scales[e] = (float)ldexp(1.0f, e - (int)(128 + 8));
+  }
+
+  g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBA32F] = convert_planar_rgbe_scalar;
+  g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBE8] = interleave_planar_rgbe_scalar;
+  g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBA16F] =
+      convert_planar_rgbe_rgba16f_scalar;
+  g_convert_planar_rgbe[HDR_PIXEL_FORMAT_B10G11R11] =
+      convert_planar_rgbe_b10g11r11_scalar;
+
+  g_pack_rgba32f[HDR_PIXEL_FORMAT_RGBA32F] = pack_rgba32f_copy;
+  g_pack_rgba32f[HDR_PIXEL_FORMAT_RGBA16F] = pack_rgba32f_rgba16f_scalar;
+  g_pack_rgba32f[HDR_PIXEL_FORMAT_B10G11R11] = pack_rgba32f_b10g11r11_scalar;
+
+#ifdef HDR_FILE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBA32F] = convert_planar_rgbe_sse2;
+    g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBE8] =
+        interleave_planar_rgbe_sse2;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBA32F] = convert_planar_rgbe_avx2;
+  }
+  if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c")) {
+    g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBA16F] =
+        convert_planar_rgbe_rgba16f_f16c;
+    g_convert_planar_rgbe[HDR_PIXEL_FORMAT_B10G11R11] =
+        convert_planar_rgbe_b10g11r11_f16c;
+    g_pack_rgba32f[HDR_PIXEL_FORMAT_RGBA16F] = pack_rgba32f_rgba16f_f16c;
+    g_pack_rgba32f[HDR_PIXEL_FORMAT_B10G11R11] = pack_rgba32f_b10g11r11_f16c;
+  }
+#endif
+}
+
+/*
+ *
+ * Scanline decoding
+ *
+ */
+
+typedef struct hdr_cursor_t {
+  const unsigned char *pos;
+  const unsigned char *end;
+} hdr_cursor_t;
+
+// Reads a flat (uncompressed) scanline of interleaved RGBE pixels
+static bool read_flat_scanline(
+    hdr_cursor_t *cursor, uint32_t width, unsigned char *planes) {
+  if ((size_t)(cursor->end - cursor->pos) < (size_t)width * 4) {
+    return false;
+  }
+
+  const unsigned char *rgbe = cursor->pos;
+  for (uint32_t i = 0; i < width; i++) {
+    planes[i] = rgbe[i * 4 + 0];
+    planes[width + i] = rgbe[i * 4 + 1];
+    planes[width * 2 + i] = rgbe[i * 4 + 2];
+    planes[width * 3 + i] = rgbe[i * 4 + 3];
+  }
+
+  cursor->pos += (size_t)width * 4;
+  return true;
+}
+
+// Reads a new-style run-length encoded scanline. Each channel is stored as a
+// separate sequence of runs and literal dumps, so they un-run straight into
+// their planes.
+static bool read_rle_scanline(
+    hdr_cursor_t *cursor, uint32_t width, unsigned char *planes) {
+  if (cursor->end - cursor->pos < 4) {
+    return false;
+  }
+
+  const unsigned char *marker = cursor->pos;
+  if (marker[0] != 2 || marker[1] != 2 ||
+      (((uint32_t)marker[2] << 8) | marker[3]) != width) {
+    return false;
+  }
+  cursor->pos += 4;
+
+  for (uint32_t c = 0; c < 4; c++) {
+    unsigned char *plane = planes + width * c;
+    uint32_t i = 0;
+
+    while (i < width) {
+      if (cursor->pos >= cursor->end) {
+        return false;
+      }
+
+      uint32_t count = *cursor->pos++;
+      if (count > 128) {
+        // Run
+        count -= 128;
+        if (count > width - i || cursor->pos >= cursor->end) {
+          return false;
+        }
+        memset(&plane[i], *cursor->pos++, count);
+      } else {
+        // Dump. Like stb_image, an empty one is treated as corrupt.
+        if (count == 0 || count > width - i ||
+            (size_t)(cursor->end - cursor->pos) < count) {
+          return false;
+        }
+        memcpy(&plane[i], cursor->pos, count);
+        cursor->pos += count;
+      }
+      i += count;
+    }
+  }
+
+  return true;
+}
+
+// Advances the cursor past a run-length encoded scanline without decoding
+// it, checking that its runs and dumps add up to the scanline width.
+static bool skip_rle_scanline(hdr_cursor_t *cursor, uint32_t width) {
+  if (cursor->end - cursor->pos < 4) {
+    return false;
+  }
+
+  const unsigned char *marker = cursor->pos;
+  if (marker[0] != 2 || marker[1] != 2 ||
+      (((uint32_t)marker[2] << 8) | marker[3]) != width) {
+    return false;
+  }
+  cursor->pos += 4;
+
+  for (uint32_t c = 0; c < 4; c++) {
+    uint32_t i = 0;
+
+    while (i < width) {
+      if (cursor->pos >= cursor->end) {
+        return false;
+      }
+
+      uint32_t count = *cursor->pos++;
+      size_t skip = 1;
+      if (count > 128) {
+        count -= 128;
+      } else {
+        skip = count;
+      }
+
+      if (count == 0 || count > width - i ||
+          (size_t)(cursor->end - cursor->pos) < skip) {
+        return false;
+      }
+
+      cursor->pos += skip;
+      i += count;
+    }
+  }
+
+  return true;
+}
+
+/*
+ *
+ * File reading
+ *
+ */
+
+// Bytes read at a time while scanning the file
+#define HDR_READ_CHUNK_SIZE (1 << 20)
+
+// Reads size bytes at offset. Doesn't move the file position, so workers can
+// read from the same file at once.
+static bool
+read_at(int fd, size_t offset, size_t size, unsigned char *dst) {
+  while (size > 0) {
+    ssize_t n = pread(fd, dst, size, (off_t)offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+
+    dst += n;
+    offset += (size_t)n;
+    size -= (size_t)n;
+  }
+
+  return true;
+}
+
+// Window over the file for a single forward pass through it
+typedef struct hdr_reader_t {
+  int fd;
+  unsigned char *buffer;
+  size_t capacity;
+
+  // File offset of the start of buffer, and how much of it is filled
+  size_t offset;
+  size_t filled;
+} hdr_reader_t;
+
+// Returns a cursor at file offset pos, over at least size bytes unless the
+// file ends first. pos must not go backwards, and size must fit in the
+// buffer.
+static bool hdr_reader_seek(
+    hdr_reader_t *reader, size_t pos, size_t size, hdr_cursor_t *cursor) {
+  assert(pos >= reader->offset && size <= reader->capacity);
+
+  if (pos + size > reader->offset + reader->filled) {
+    // Keep what is left of the window and fill the rest of the buffer
+    size_t keep = 0;
+    if (pos < reader->offset + reader->filled) {
+      keep = reader->offset + reader->filled - pos;
+      memmove(reader->buffer, &reader->buffer[pos - reader->offset], keep);
+    }
+    reader->offset = pos;
+    reader->filled = keep;
+
+    while (reader->filled < reader->capacity) {
+      ssize_t n = pread(
+          reader->fd,
+          &reader->buffer[reader->filled],
+          reader->capacity - reader->filled,
+          (off_t)(reader->offset + reader->filled));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        return false;
+      }
+      if (n == 0) {
+        break;
+      }
+      reader->filled += (size_t)n;
+    }
+  }
+
+  cursor->pos = &reader->buffer[pos - reader->offset];
+  cursor->end = &reader->buffer[reader->filled];
+  return true;
+}
+
+// Same rule as stb_image: the image is run-length encoded if its width allows
+// it and the first scanline starts with the RLE marker. Otherwise all
+// scanlines are flat.
+static bool is_rle_image(const hdr_file_t *file, const hdr_cursor_t *cursor) {
+  if (file->width < 8 || file->width >= 32768) {
+    return false;
+  }
+
+  if (cursor->end - cursor->pos < 4) {
+    return false;
+  }
+
+  const unsigned char *marker = cursor->pos;
+  return marker[0] == 2 && marker[1] == 2 && (marker[2] & 0x80) == 0;
+}
+
+// Pre-scan that records the offset of every scanline. Flat scanlines have a
+// fixed size, RLE ones are walked with skip_rle_scanline. Reads the file
+// through a window that only needs to hold the largest possible scanline.
+static bool find_scanline_offsets(hdr_file_t *file) {
+  file->scanline_offsets = malloc(sizeof(size_t) * ((size_t)file->height + 1));
+  if (file->scanline_offsets == NULL) {
+    return false;
+  }
+
+  // Runs and dumps both take at least two bytes for a single texel, so an RLE
+  // scanline is never larger than twice a flat one plus its marker
+  size_t flat_size = (size_t)file->width * 4;
+  size_t max_size = 2 * flat_size + 4;
+
+  hdr_reader_t reader = {
+      .fd = file->fd,
+      .capacity = max_size + HDR_READ_CHUNK_SIZE,
+      .offset = file->pixels_offset,
+  };
+  reader.buffer = malloc(reader.capacity);
+  if (reader.buffer == NULL) {
+    return false;
+  }
+
+  bool ok = true;
+  size_t offset = file->pixels_offset;
+  for (uint32_t y = 0; y < file->height; y++) {
+    hdr_cursor_t cursor;
+    if (!hdr_reader_seek(&reader, offset, max_size, &cursor)) {
+      ok = false;
+      break;
+    }
+
+    if (y == 0) {
+      file->rle = is_rle_image(file, &cursor);
+    }
+
+    const unsigned char *start = cursor.pos;
+    if (file->rle) {
+      if (!skip_rle_scanline(&cursor, file->width)) {
+        ok = false;
+        break;
+      }
+    } else {
+      if ((size_t)(cursor.end - cursor.pos) < flat_size) {
+        ok = false;
+        break;
+      }
+      cursor.pos += flat_size;
+    }
+
+    size_t size = (size_t)(cursor.pos - start);
+    if (size > file->max_scanline_size) {
+      file->max_scanline_size = size;
+    }
+
+    file->scanline_offsets[y] = offset;
+    offset += size;
+  }
+  file->scanline_offsets[file->height] = offset;
+
+  free(reader.buffer);
+  return ok;
+}
+
+// Reads scanline y into encoded, which holds max_scanline_size bytes, and
+// decodes it into planes
+static bool decode_scanline(
+    const hdr_file_t *file,
+    uint32_t y,
+    unsigned char *encoded,
+    unsigned char *planes) {
+  size_t offset = file->scanline_offsets[y];
+  size_t size = file->scanline_offsets[y + 1] - offset;
+  if (!read_at(file->fd, offset, size, encoded)) {
+    return false;
+  }
+
+  hdr_cursor_t cursor = {encoded, encoded + size};
+
+  if (file->rle) {
+    return read_rle_scanline(&cursor, file->width, planes);
+  }
+  return read_flat_scanline(&cursor, file->width, planes);
+}
+
+/*
+ *
+ * Parallel decoding
+ *
+ */
+
+#define HDR_DECODE_BAND_ROWS 16
+#define HDR_MAX_WORKERS 64
+
+typedef struct decode_job_t {
+  const hdr_file_t *file;
+  convert_planar_rgbe_fn convert;
+  unsigned char *pixels;
+  size_t row_size;
+
+  // Scanlines to decode, the first one going to the start of pixels
+  uint32_t first_row;
+  uint32_t end_row;
+  uint32_t band_count;
+
+  // Accessed atomically by the workers
+  uint32_t next_band;
+  uint32_t failed;
+} decode_job_t;
+
+static void *decode_worker(void *arg) {
+  decode_job_t *job = arg;
+  const hdr_file_t *file = job->file;
+
+  unsigned char *encoded = malloc(file->max_scanline_size);
+  unsigned char *planes = malloc((size_t)file->width * 4);
+  if (encoded == NULL || planes == NULL) {
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    goto done;
+  }
+
+  for (;;) {
+    uint32_t band = __atomic_fetch_add(&job->next_band, 1, __ATOMIC_RELAXED);
+    if (band >= job->band_count ||
+        __atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+      break;
+    }
+
+    uint32_t first_row = job->first_row + band * HDR_DECODE_BAND_ROWS;
+    uint32_t last_row = first_row + HDR_DECODE_BAND_ROWS;
+    if (last_row > job->end_row) {
+      last_row = job->end_row;
+    }
+
+    for (uint32_t y = first_row; y < last_row; y++) {
+      if (!decode_scanline(file, y, encoded, planes)) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        break;
+      }
+
+      size_t row = y - job->first_row;
+      job->convert(planes, file->width, &job->pixels[row * job->row_size]);
+    }
+  }
+
+done:
+  free(encoded);
+  free(planes);
+  return NULL;
+}
+
+static uint32_t worker_count() {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 1) {
+    return 1;
+  }
+  if (cpus > HDR_MAX_WORKERS) {
+    return HDR_MAX_WORKERS;
+  }
+  return (uint32_t)cpus;
+}
+
+// Runs worker on one thread per CPU, but no more than there are bands of
+// work. The calling thread is one of the workers.
+static void
+run_workers(void *(*worker)(void *), void *job, uint32_t band_count) {
+  uint32_t thread_count = worker_count();
+  if (thread_count > band_count) {
+    thread_count = band_count;
+  }
+
+  pthread_t threads[HDR_MAX_WORKERS];
+  uint32_t started = 0;
+  for (uint32_t i = 1; i < thread_count; i++) {
+    if (pthread_create(&threads[started], NULL, worker, job) == 0) {
+      started++;
+    }
+  }
+
+  worker(job);
+
+  for (uint32_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+/*
+ *
+ * Resampling
+ *
+ */
+
+// Output rows resampled by a worker at a time. Each band starts with an
+// empty row window, so bands are larger than decode bands to keep the
+// number of scanlines decoded twice low.
+#define HDR_RESAMPLE_BAND_ROWS 32
+
+// Source taps of every output texel along one axis: tap_count indices, with
+// out of range ones already wrapped or clamped, and their weights.
+typedef struct resample_axis_t {
+  uint32_t tap_count;
+  uint32_t *indices;
+  float *weights;
+} resample_axis_t;
+
+static float lanczos3(float x) {
+  if (x == 0.0f) {
+    return 1.0f;
+  }
+  if (fabsf(x) >= 3.0f) {
+    return 0.0f;
+  }
+
+  const float pi = 3.14159265358979323846f;
+  return 3.0f * sinf(pi * x) * sinf(pi * x / 3.0f) / (pi * pi * x * x);
+}
+
+static bool resample_axis_init(
+    resample_axis_t *axis,
+    hdr_filter_t filter,
+    uint32_t src_size,
+    uint32_t dst_size,
+    bool wrap) {
+  float scale = (float)src_size / (float)dst_size;
+  float support = (filter == HDR_FILTER_LANCZOS3 ? 3.0f : 0.5f) * scale;
+
+  axis->tap_count = (uint32_t)ceilf(2.0f * support) + 1;
+  axis->indices = malloc((size_t)dst_size * axis->tap_count * sizeof(uint32_t));
+  axis->weights = malloc((size_t)dst_size * axis->tap_count * sizeof(float));
+  if (axis->indices == NULL || axis->weights == NULL) {
+    return false;
+  }
+
+  for (uint32_t j = 0; j < dst_size; j++) {
+    uint32_t *indices = &axis->indices[(size_t)j * axis->tap_count];
+    float *weights = &axis->weights[(size_t)j * axis->tap_count];
+
+    float center = ((float)j + 0.5f) * scale;
+    int64_t first = (int64_t)floorf(center - support);
+
+    float weight_sum = 0.0f;
+    for (uint32_t k = 0; k < axis->tap_count; k++) {
+      int64_t i = first + k;
+
+      if (filter == HDR_FILTER_LANCZOS3) {
+        weights[k] = lanczos3(((float)i + 0.5f - center) / scale);
+      } else {
+        // Area of the source texel covered by the output texel
+        float lo = fmaxf((float)i, center - support);
+        float hi = fminf((float)i + 1.0f, center + support);
+        weights[k] = fmaxf(hi - lo, 0.0f);
+      }
+      weight_sum += weights[k];
+
+      if (wrap) {
+        i = (i % src_size + src_size) % src_size;
+      } else if (i < 0) {
+        i = 0;
+      } else if (i >= src_size) {
+        i = src_size - 1;
+      }
+      indices[k] = (uint32_t)i;
+    }
+
+    for (uint32_t k = 0; k < axis->tap_count; k++) {
+      weights[k] /= weight_sum;
+    }
+  }
+
+  return true;
+}
+
+static void resample_axis_destroy(resample_axis_t *axis) {
+  free(axis->indices);
+  free(axis->weights);
+}
+
+// Filters one RGBA32F row along the horizontal axis
+static void resample_row(
+    const resample_axis_t *axis,
+    uint32_t dst_width,
+    const float *src,
+    float *dst) {
+  for (uint32_t j = 0; j < dst_width; j++) {
+    const uint32_t *indices = &axis->indices[(size_t)j * axis->tap_count];
+    const float *weights = &axis->weights[(size_t)j * axis->tap_count];
+
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+    for (uint32_t k = 0; k < axis->tap_count; k++) {
+      const float *texel = &src[(size_t)indices[k] * 4];
+      r += weights[k] * texel[0];
+      g += weights[k] * texel[1];
+      b += weights[k] * texel[2];
+    }
+
+    dst[j * 4 + 0] = r;
+    dst[j * 4 + 1] = g;
+    dst[j * 4 + 2] = b;
+    dst[j * 4 + 3] = 1.0f;
+  }
+}
+
+typedef struct resample_job_t {
+  const hdr_file_t *file;
+  pack_rgba32f_fn pack;
+  unsigned char *pixels;
+  size_t row_size;
+  uint32_t width;
+  uint32_t height;
+
+  resample_axis_t horizontal;
+  resample_axis_t vertical;
+
+  uint32_t band_count;
+
+  // Accessed atomically by the workers
+  uint32_t next_band;
+  uint32_t failed;
+} resample_job_t;
+
+static void *resample_worker(void *arg) {
+  resample_job_t *job = arg;
+  const hdr_file_t *file = job->file;
+
+  // Horizontally filtered source rows, in a ring indexed by source row
+  // modulo the vertical tap count. Every output row needs a window of
+  // consecutive source rows that only moves forward, so the ring never
+  // evicts a row that is still needed.
+  uint32_t window_size = job->vertical.tap_count;
+  size_t window_row_size = (size_t)job->width * 4;
+
+  unsigned char *encoded = malloc(file->max_scanline_size);
+  unsigned char *planes = malloc((size_t)file->width * 4);
+  float *row = malloc((size_t)file->width * 4 * sizeof(float));
+  float *window = malloc(window_row_size * window_size * sizeof(float));
+  int64_t *window_rows = malloc(window_size * sizeof(int64_t));
+  float *dst = malloc(window_row_size * sizeof(float));
+  if (encoded == NULL || planes == NULL || row == NULL || window == NULL ||
+      window_rows == NULL || dst == NULL) {
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    goto done;
+  }
+
+  for (;;) {
+    uint32_t band = __atomic_fetch_add(&job->next_band, 1, __ATOMIC_RELAXED);
+    if (band >= job->band_count ||
+        __atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+      break;
+    }
+
+    for (uint32_t i = 0; i < window_size; i++) {
+      window_rows[i] = -1;
+    }
+
+    uint32_t first_row = band * HDR_RESAMPLE_BAND_ROWS;
+    uint32_t last_row = first_row + HDR_RESAMPLE_BAND_ROWS;
+    if (last_row > job->height) {
+      last_row = job->height;
+    }
+
+    for (uint32_t j = first_row; j < last_row; j++) {
+      const uint32_t *indices =
+          &job->vertical.indices[(size_t)j * window_size];
+      const float *weights = &job->vertical.weights[(size_t)j * window_size];
+
+      memset(dst, 0, window_row_size * sizeof(float));
+
+      for (uint32_t k = 0; k < window_size; k++) {
+        uint32_t y = indices[k];
+        float *src = &window[(y % window_size) * window_row_size];
+
+        if (window_rows[y % window_size] != y) {
+          if (!decode_scanline(file, y, encoded, planes)) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            goto done;
+          }
+          g_convert_planar_rgbe[HDR_PIXEL_FORMAT_RGBA32F](
+              planes, file->width, row);
+          resample_row(&job->horizontal, job->width, row, src);
+          window_rows[y % window_size] = y;
+        }
+
+        for (size_t i = 0; i < window_row_size; i++) {
+          dst[i] += weights[k] * src[i];
+        }
+      }
+
+      // Lanczos lobes can ring below zero around bright texels
+      for (uint32_t x = 0; x < job->width; x++) {
+        dst[x * 4 + 0] = fmaxf(dst[x * 4 + 0], 0.0f);
+        dst[x * 4 + 1] = fmaxf(dst[x * 4 + 1], 0.0f);
+        dst[x * 4 + 2] = fmaxf(dst[x * 4 + 2], 0.0f);
+        dst[x * 4 + 3] = 1.0f;
+      }
+
+      job->pack(dst, job->width, &job->pixels[(size_t)j * job->row_size]);
+    }
+  }
+
+done:
+  free(encoded);
+  free(planes);
+  free(row);
+  free(window);
+  free(window_rows);
+  free(dst);
+  return NULL;
+}
+
+/*
+ *
+ * Header parsing
+ *
+ */
+
+// Returns the next line, without its newline, as a NUL-terminated string in
+// buffer. Long lines are truncated.
+static const char *
+read_header_line(hdr_cursor_t *cursor, char *buffer, size_t buffer_size) {
+  size_t len = 0;
+  while (cursor->pos < cursor->end && *cursor->pos != '\n') {
+    if (len < buffer_size - 1) {
+      buffer[len++] = (char)*cursor->pos;
+    }
+    cursor->pos++;
+  }
+
+  if (cursor->pos < cursor->end) {
+    cursor->pos++; // newline
+  }
+
+  buffer[len] = 0;
+  return buffer;
+}
+
+// Parses the header at the start of data, which holds the first size bytes
+// of the file
+static bool
+parse_header(hdr_file_t *file, const unsigned char *data, size_t size) {
+  hdr_cursor_t cursor = {data, data + size};
+  char buffer[1024];
+
+  const char *line = read_header_line(&cursor, buffer, sizeof(buffer));
+  if (strcmp(line, "#?RADIANCE") != 0 && strcmp(line, "#?RGBE") != 0) {
+    return false;
+  }
+
+  bool valid = false;
+  for (;;) {
+    if (cursor.pos >= cursor.end) {
+      return false;
+    }
+
+    line = read_header_line(&cursor, buffer, sizeof(buffer));
+    if (line[0] == 0) {
+      break;
+    }
+
+    if (strcmp(line, "FORMAT=32-bit_rle_rgbe") == 0) {
+      valid = true;
+    }
+  }
+
+  if (!valid) {
+    return false;
+  }
+
+  // Only the standard "-Y height +X width" orientation is supported
+  line = read_header_line(&cursor, buffer, sizeof(buffer));
+
+  char *token = (char *)line;
+  if (strncmp(token, "-Y ", 3) != 0) {
+    return false;
+  }
+  token += 3;
+  long height = strtol(token, &token, 10);
+  while (*token == ' ') {
+    token++;
+  }
+  if (strncmp(token, "+X ", 3) != 0) {
+    return false;
+  }
+  token += 3;
+  long width = strtol(token, NULL, 10);
+
+  if (width <= 0 || height <= 0 || width > (1 << 24) || height > (1 << 24)) {
+    return false;
+  }
+
+  file->width = (uint32_t)width;
+  file->height = (uint32_t)height;
+  file->pixels_offset = (size_t)(cursor.pos - data);
+
+  return true;
+}
+
+/*
+ *
+ * Public API
+ *
+ */
+
+bool hdr_file_open(hdr_file_t *file, const char *path) {
+  memset(file, 0, sizeof(*file));
+
+  file->fd = open(path, O_RDONLY);
+  if (file->fd < 0) {
+    return false;
+  }
+
+  // Headers are a few short lines, a chunk holds any sensible one
+  unsigned char *header = malloc(HDR_READ_CHUNK_SIZE);
+  if (header == NULL) {
+    hdr_file_close(file);
+    return false;
+  }
+
+  ssize_t size;
+  do {
+    size = pread(file->fd, header, HDR_READ_CHUNK_SIZE, 0);
+  } while (size < 0 && errno == EINTR);
+
+  bool ok = size > 0 && parse_header(file, header, (size_t)size);
+  free(header);
+
+  if (!ok || !find_scanline_offsets(file)) {
+    hdr_file_close(file);
+    return false;
+  }
+
+  return true;
+}
+
+size_t hdr_pixel_format_size(hdr_pixel_format_t format) {
+  switch (format) {
+  case HDR_PIXEL_FORMAT_RGBA32F:
+    return 4 * sizeof(float);
+  case HDR_PIXEL_FORMAT_RGBE8:
+    return 4;
+  case HDR_PIXEL_FORMAT_RGBA16F:
+    return 4 * sizeof(uint16_t);
+  case HDR_PIXEL_FORMAT_B10G11R11:
+    return sizeof(uint32_t);
+  default:
+    return 0;
+  }
+}
+
+bool hdr_file_decode(
+    hdr_file_t *file, hdr_pixel_format_t format, void *pixels) {
+  return hdr_file_decode_rows(file, format, 0, file->height, pixels);
+}
+
+bool hdr_file_decode_rows(
+    hdr_file_t *file,
+    hdr_pixel_format_t format,
+    uint32_t first_row,
+    uint32_t row_count,
+    void *pixels) {
+  if (first_row > file->height || row_count > file->height - first_row) {
+    return false;
+  }
+
+  init_convert_kernels();
+
+  decode_job_t job = {
+      .file = file,
+      .convert = g_convert_planar_rgbe[format],
+      .pixels = pixels,
+      .row_size = (size_t)file->width * hdr_pixel_format_size(format),
+      .first_row = first_row,
+      .end_row = first_row + row_count,
+      .band_count =
+          (row_count + HDR_DECODE_BAND_ROWS - 1) / HDR_DECODE_BAND_ROWS,
+      .next_band = 0,
+      .failed = 0,
+  };
+
+  run_workers(decode_worker, &job, job.band_count);
+
+  return job.failed == 0;
+}
+
+bool hdr_file_decode_resampled(
+    hdr_file_t *file,
+    hdr_filter_t filter,
+    hdr_pixel_format_t format,
+    uint32_t width,
+    uint32_t height,
+    void *pixels) {
+  if (format == HDR_PIXEL_FORMAT_RGBE8) {
+    return false;
+  }
+
+  init_convert_kernels();
+
+  resample_job_t job = {
+      .file = file,
+      .pack = g_pack_rgba32f[format],
+      .pixels = pixels,
+      .row_size = (size_t)width * hdr_pixel_format_size(format),
+      .width = width,
+      .height = height,
+      .band_count =
+          (height + HDR_RESAMPLE_BAND_ROWS - 1) / HDR_RESAMPLE_BAND_ROWS,
+      .next_band = 0,
+      .failed = 0,
+  };
+
+  // Equirect maps wrap around horizontally, and are clamped at the poles
+  bool ok =
+      resample_axis_init(&job.horizontal, filter, file->width, width, true) &&
+      resample_axis_init(&job.vertical, filter, file->height, height, false);
+
+  if (ok) {
+    run_workers(resample_worker, &job, job.band_count);
+    ok = job.failed == 0;
+  }
+
+  resample_axis_destroy(&job.horizontal);
+  resample_axis_destroy(&job.vertical);
+
+  return ok;
+}
+
+void hdr_pack_rgba32f(
+    hdr_pixel_format_t format, const float *src, size_t count, void *dst) {
+  assert(format != HDR_PIXEL_FORMAT_RGBE8);
+
+  init_convert_kernels();
+  g_pack_rgba32f[format](src, count, dst);
+}
+
+void hdr_file_close(hdr_file_t *file) {
+  if (file->fd >= 0) {
+    close(file->fd);
+  }
+  free(file->scanline_offsets);
+  file->fd = -1;
+  file->scanline_offsets = NULL;
+}
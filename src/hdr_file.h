@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Reader for Radiance .hdr (RGBE) files.
+//
+// Pixels are decoded either to RGBA32F with alpha set to 1.0, giving the same
+// values as stbi_loadf(path, &w, &h, &c, 4) bit for bit, to the raw RGBE
+// bytes so the float expansion can be done on the GPU, or to one of the
+// smaller float formats below.
+
+typedef enum hdr_pixel_format_t {
+  HDR_PIXEL_FORMAT_RGBA32F,
+  HDR_PIXEL_FORMAT_RGBE8,
+  // Half floats, rounded to nearest and clamped to 65504. Matches
+  // VK_FORMAT_R16G16B16A16_SFLOAT.
+  HDR_PIXEL_FORMAT_RGBA16F,
+  // 11, 11 and 10 bit unsigned floats packed into 32 bits, red in the low
+  // bits and no alpha. Matches VK_FORMAT_B10G11R11_UFLOAT_PACK32.
+  HDR_PIXEL_FORMAT_B10G11R11,
+  HDR_PIXEL_FORMAT_COUNT,
+} hdr_pixel_format_t;
+
+typedef enum hdr_filter_t {
+  HDR_FILTER_BOX,
+  HDR_FILTER_LANCZOS3,
+} hdr_filter_t;
+
+typedef struct hdr_file_t {
+  // Kept open, scanlines are read from it as they are decoded
+  int fd;
+
+  // Offset of the first scanline in the file
+  size_t pixels_offset;
+
+  uint32_t width;
+  uint32_t height;
+
+  // Whether scanlines are run-length encoded, and where each of them starts
+  // in the file, plus where the last one ends. Scanlines are independent, so
+  // any range of them can be decoded on its own.
+  bool rle;
+  size_t *scanline_offsets;
+
+  // Encoded size of the largest scanline
+  size_t max_scanline_size;
+} hdr_file_t;
+
+// Opens the file, parses its header and locates every scanline, reading it
+// through once. The encoded image is never held in memory as a whole, decoding
+// reads back only the scanlines it needs. Returns false if the file can't be
+// read or is not a Radiance file we can decode.
+bool hdr_file_open(hdr_file_t *file, const char *path);
+
+// Size in bytes of one pixel in the given format
+size_t hdr_pixel_format_size(hdr_pixel_format_t format);
+
+// Decodes all scanlines into pixels, which must hold width * height pixels of
+// the given format. Bands of scanlines are decoded in parallel on one thread
+// per CPU. Returns false if the pixel data is corrupt or memory runs out.
+bool hdr_file_decode(
+    hdr_file_t *file, hdr_pixel_format_t format, void *pixels);
+
+// Same as hdr_file_decode, but only for row_count scanlines starting at
+// first_row, which land at the start of pixels.
+bool hdr_file_decode_rows(
+    hdr_file_t *file,
+    hdr_pixel_format_t format,
+    uint32_t first_row,
+    uint32_t row_count,
+    void *pixels);
+
+// Decodes the image resampled to width x height pixels, filtering scanlines
+// as they are decoded so that only a few rows of the full size image are
+// held at a time. Meant for downsampling, the filter is widened by the scale
+// factor. Filtering is done in RGBA32F, so RGBE8 is not a valid format.
+bool hdr_file_decode_resampled(
+    hdr_file_t *file,
+    hdr_filter_t filter,
+    hdr_pixel_format_t format,
+    uint32_t width,
+    uint32_t height,
+    void *pixels);
+
+// Converts count RGBA32F pixels, from any source, to a format other than
+// RGBE8
+void hdr_pack_rgba32f(
+    hdr_pixel_format_t format, const float *src, size_t count, void *dst);
+
+void hdr_file_close(hdr_file_t *file);
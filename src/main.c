@@ -1,15 +1,22 @@
+#include "cube_face.h"
 #include "env_file.h"
+#include "hdr_file.h"
+#include "sh.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 #include "vk_mem_alloc.h"
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <vulkan/vulkan.h>
 
 #define ARRAYSIZE(array) (sizeof(array) / sizeof((array)[0]))
 
+// M_PI is POSIX, not C99
+#define PI 3.14159265358979323846f
+
 #define VK_CHECK(exp)                                                          \
   do {                                                                         \
     VkResult result = exp;                                                     \
@@ -38,14 +45,22 @@ const char *const REQUIRED_INSTANCE_EXTENSIONS[] = {};
 
 const char *const REQUIRED_DEVICE_EXTENSIONS[] = {};
 
-typedef union mat4_t {
-  float elems[16];
-  float columns[4][4];
-} mat4_t;
-
 typedef struct push_constant_t {
-  mat4_t mvp;
   float roughness;
+  // Level of the source cubemap a bake reads
+  uint32_t source_level;
+  // Samples per texel, for stages that take a variable number, and where
+  // the samples of the level start in the sample table
+  uint32_t sample_count;
+  uint32_t sample_offset;
+
+  // Equirect tile being rendered: the part of the panorama it covers in uv
+  // space, and the scale and offset taking panorama uvs to tile image uvs
+  float tile_rect[4];
+  float tile_transform[4];
+  // Bit per face the bake leaves alone, for stages that finish some faces
+  // before others
+  uint32_t skip_faces;
 } push_constant_t;
 
 typedef struct cubemap_t {
@@ -62,77 +77,66 @@ typedef struct cubemap_t {
   uint32_t mip_levels;
 } cubemap_t;
 
-// clang-format off
-const mat4_t camera_views[6] = {
-  (mat4_t){.elems = {
-    0.0, 0.0, -1.0, 0.0, 
-    0.0, -1.0, -0.0, 0.0,
-    -1.0, 0.0, -0.0, 0.0,
-    -0.0, -0.0, 0.0, 1.0,
-  }},
-  (mat4_t){.elems = {
-      0.0, 0.0, 1.0, 0.0,
-      0.0, -1.0, -0.0, 0.0,
-      1.0, 0.0, -0.0, 0.0,
-      -0.0, -0.0, 0.0, 1.0,
-    }},
-  (mat4_t){.elems = {
-      1.0, 0.0, -0.0, 0.0,
-      0.0, 0.0, -1.0, 0.0,
-      0.0, 1.0, -0.0, 0.0,
-      -0.0, -0.0, 0.0, 1.0,
-    }},
-  (mat4_t){.elems = {
-      1.0, 0.0, -0.0, 0.0,
-      0.0, 0.0, 1.0, 0.0,
-      0.0, -1.0, -0.0, 0.0,
-      -0.0, -0.0, 0.0, 1.0,
-    }},
-  (mat4_t){.elems = {
-      1.0, 0.0, -0.0, 0.0,
-      0.0, -1.0, -0.0, 0.0,
-      -0.0, 0.0, -1.0, 0.0,
-      -0.0, -0.0, 0.0, 1.0,
-    }},
-  (mat4_t){.elems = {
-      -1.0, 0.0, -0.0, 0.0,
-      -0.0, -1.0, -0.0, 0.0,
-      -0.0, 0.0, 1.0, 0.0,
-      0.0, -0.0, 0.0, 1.0,
-    }},
-};
-// clang-format on
-
-float to_radians(float degrees) {
-  return degrees * (3.14159265358979323846 / 180.0f);
-}
-
-static inline mat4_t
-mat4_perspective(float fovy, float aspect_ratio, float znear, float zfar) {
-  mat4_t result = {{0}};
-
-  float tan_half_fovy = tan(fovy / 2.0f);
-
-  result.columns[0][0] = 1.0f / (aspect_ratio * tan_half_fovy);
-  result.columns[1][1] = 1.0f / tan_half_fovy;
-  result.columns[2][2] = -(zfar + znear) / (zfar - znear);
-  result.columns[2][3] = -1.0f;
-  result.columns[3][2] = -(2.0 * zfar * znear) / (zfar - znear);
-
-  return result;
-}
-
-static inline mat4_t mat4_mul(mat4_t left, mat4_t right) {
-  mat4_t result = {{0}};
-  for (unsigned char i = 0; i < 4; i++) {
-    for (unsigned char j = 0; j < 4; j++) {
-      for (unsigned char p = 0; p < 4; p++) {
-        result.columns[i][j] += left.columns[i][p] * right.columns[p][j];
-      }
-    }
-  }
-  return result;
-}
+typedef enum bake_backend_t {
+  // Rasterizes the cube into each cubemap level
+  BAKE_BACKEND_GRAPHICS,
+  // Dispatches one invocation per texel, writing storage image views
+  BAKE_BACKEND_COMPUTE,
+} bake_backend_t;
+
+typedef enum irradiance_mode_t {
+  // Convolves the skybox with the cosine lobe for every irradiance texel
+  IRRADIANCE_MODE_CONVOLVE,
+  // Projects the skybox onto order 2 spherical harmonics in one pass and
+  // reconstructs irradiance from the 9 coefficients
+  IRRADIANCE_MODE_SH,
+} irradiance_mode_t;
+
+typedef enum radiance_mode_t {
+  // Convolves the skybox with the full GGX lobe of every level
+  RADIANCE_MODE_SKYBOX,
+  // Convolves each level from the one before it with the lobe making up the
+  // roughness difference, at the same small cost for every level
+  RADIANCE_MODE_HIERARCHICAL,
+} radiance_mode_t;
+
+typedef struct bake_options_t {
+  const char *in_path;
+  const char *out_path;
+
+  // Expand RGBE to floats on the CPU instead of in the skybox shader
+  bool cpu_decode;
+
+  // Filter Radiance equirects larger than the skybox can use down to its
+  // resolution while decoding them
+  bool downsample;
+  hdr_filter_t downsample_filter;
+
+  // What float equirects are stored and uploaded as. Radiance files decoded
+  // on the GPU stay RGBE8. The smaller formats clamp bright texels, such as
+  // a direct sun, so they are opt-in.
+  hdr_pixel_format_t source_format;
+
+  // Whether bake stages run as render passes or compute dispatches
+  bake_backend_t backend;
+
+  // How the irradiance cubemap is computed from the skybox
+  irradiance_mode_t irradiance_mode;
+
+  // Store the irradiance spherical harmonics in the output as well
+  bool sh_irradiance;
+
+  // How the rough radiance levels are filtered
+  radiance_mode_t radiance_mode;
+
+  // GGX samples per texel of the first rough radiance level, the others
+  // take fewer
+  uint32_t radiance_sample_count;
+
+  // Relative error at which progressive radiance sampling stops adding
+  // samples to a face, or 0 to take a fixed count
+  float radiance_max_error;
+} bake_options_t;
 
 VkInstance g_instance = VK_NULL_HANDLE;
 VkDevice g_device = VK_NULL_HANDLE;
@@ -152,6 +156,9 @@ VkDescriptorPool g_descriptor_pool = VK_NULL_HANDLE;
 
 VkDescriptorSetLayout g_bake_cubemap_descriptor_set_layout = VK_NULL_HANDLE;
 
+// Binding of the sample table of stages that precompute their samples
+#define BAKE_SAMPLES_BINDING 2
+
 unsigned char *load_bytes_from_file(const char *path, size_t *size) {
   FILE *file = fopen(path, "rb");
   if (file == NULL)
@@ -237,6 +244,12 @@ void set_image_layout(
     // Make sure any shader reads from the image have been finished
     image_memory_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
     break;
+
+  case VK_IMAGE_LAYOUT_GENERAL:
+    // Image is a storage image
+    // Make sure any shader writes to the image have been finished
+    image_memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    break;
   default:
     // Other source layouts aren't handled (yet)
     break;
@@ -280,6 +293,11 @@ void set_image_layout(
     }
     image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
     break;
+
+  case VK_IMAGE_LAYOUT_GENERAL:
+    // Image will be written as a storage image
+    image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    break;
   default:
     // Other source layouts aren't handled (yet)
     break;
@@ -300,6 +318,7 @@ void set_image_layout(
 
 static inline VkGraphicsPipelineCreateInfo default_pipeline_create_info(
     VkShaderModule vertex_module,
+    VkShaderModule geometry_module,
     VkShaderModule fragment_module,
     VkPipelineLayout pipeline_layout,
     VkRenderPass render_pass) {
@@ -415,7 +434,7 @@ static inline VkGraphicsPipelineCreateInfo default_pipeline_create_info(
           dynamic_states,                      // pDyanmicStates
       };
 
-  static VkPipelineShaderStageCreateInfo pipeline_stages[2] = {
+  static VkPipelineShaderStageCreateInfo pipeline_stages[3] = {
       {
           VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType
           NULL,                                                // pNext
@@ -425,6 +444,15 @@ static inline VkGraphicsPipelineCreateInfo default_pipeline_create_info(
           "main",                                              // pName
           NULL, // pSpecializationInfo
       },
+      {
+          VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType
+          NULL,                                                // pNext
+          0,                                                   // flags
+          VK_SHADER_STAGE_GEOMETRY_BIT,                        // stage
+          VK_NULL_HANDLE,                                      // module
+          "main",                                              // pName
+          NULL, // pSpecializationInfo
+      },
       {
           VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType
           NULL,                                                // pNext
@@ -437,7 +465,8 @@ static inline VkGraphicsPipelineCreateInfo default_pipeline_create_info(
   };
 
   pipeline_stages[0].module = vertex_module;
-  pipeline_stages[1].module = fragment_module;
+  pipeline_stages[1].module = geometry_module;
+  pipeline_stages[2].module = fragment_module;
 
   return (VkGraphicsPipelineCreateInfo){
       VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
@@ -622,8 +651,10 @@ static inline bool check_validation_layer_support() {
   return true;
 }
 
-static inline bool
-check_physical_device_properties(VkPhysicalDevice physical_device) {
+// The geometry stage is only needed by the graphics backend, which lays the
+// cube faces out with it
+static inline bool check_physical_device_properties(
+    VkPhysicalDevice physical_device, bake_backend_t backend) {
   uint32_t extension_count;
   vkEnumerateDeviceExtensionProperties(
       physical_device, NULL, &extension_count, NULL);
@@ -670,7 +701,8 @@ check_physical_device_properties(VkPhysicalDevice physical_device) {
   // Check for required device features
   VkPhysicalDeviceFeatures features = {};
   vkGetPhysicalDeviceFeatures(physical_device, &features);
-  if (!features.wideLines) {
+  if (!features.wideLines ||
+      (backend == BAKE_BACKEND_GRAPHICS && !features.geometryShader)) {
     printf(
         "Physical device %s doesn't support required features!\n",
         device_properties.deviceName);
@@ -762,7 +794,7 @@ static inline void setup_debug_callback() {
       g_instance, &createInfo, NULL, &g_debug_callback));
 }
 
-static inline void create_device() {
+static inline void create_device(bake_backend_t backend) {
   uint32_t physical_device_count;
   vkEnumeratePhysicalDevices(g_instance, &physical_device_count, NULL);
   VkPhysicalDevice *physical_devices =
@@ -771,7 +803,7 @@ static inline void create_device() {
       g_instance, &physical_device_count, physical_devices);
 
   for (uint32_t i = 0; i < physical_device_count; i++) {
-    if (check_physical_device_properties(physical_devices[i])) {
+    if (check_physical_device_properties(physical_devices[i], backend)) {
       g_physical_device = physical_devices[i];
       break;
     }
@@ -858,7 +890,9 @@ static inline void create_command_pool() {
 
 static inline void create_descriptor_pool() {
   VkDescriptorPoolSize pool_sizes[] = {
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10},
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 64},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 64},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 64},
   };
 
   VkDescriptorPoolCreateInfo create_info = {
@@ -875,13 +909,24 @@ static inline void create_descriptor_pool() {
 }
 
 static inline void create_descriptor_set_layout() {
-  VkDescriptorSetLayoutBinding bindings[] = {{
-      0,                                         // binding
-      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // descriptorType
-      1,                                         // descriptorCount
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, // stageFlags
-      NULL, // pImmutableSamplers
-  }};
+  // Binding 1 is left unused here, so that both layouts share binding
+  // numbers. The compute layout puts its storage image there.
+  VkDescriptorSetLayoutBinding bindings[] = {
+      {
+          0,                                         // binding
+          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // descriptorType
+          1,                                         // descriptorCount
+          VK_SHADER_STAGE_FRAGMENT_BIT,              // stageFlags
+          NULL,                                      // pImmutableSamplers
+      },
+      {
+          BAKE_SAMPLES_BINDING,              // binding
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // descriptorType
+          1,                                 // descriptorCount
+          VK_SHADER_STAGE_FRAGMENT_BIT,      // stageFlags
+          NULL,                              // pImmutableSamplers
+      },
+  };
 
   VkDescriptorSetLayoutCreateInfo create_info = {};
   create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -894,7 +939,7 @@ static inline void create_descriptor_set_layout() {
       g_device, &create_info, NULL, &g_bake_cubemap_descriptor_set_layout);
 }
 
-static inline void vulkan_setup() {
+static inline void vulkan_setup(bake_backend_t backend) {
   create_instance();
 
 #ifdef ENABLE_VALIDATION
@@ -903,7 +948,7 @@ static inline void vulkan_setup() {
   }
 #endif
 
-  create_device();
+  create_device(backend);
   get_device_queues();
   setup_memory_allocator();
   create_command_pool();
@@ -929,171 +974,44 @@ static inline void vulkan_teardown() {
 
 /*
  *
- * Canvas stuff
+ * Render target stuff
  *
  */
 
-typedef struct canvas_t {
+// One mip level of a cubemap, rendered to through a 2D array view of its six
+// faces. cube_faces.geom routes every primitive to its face's layer, so a
+// single render pass and draw cover the whole level.
+typedef struct cube_target_t {
   uint32_t width;
   uint32_t height;
 
-  VkRenderPass render_pass;
-
-  VkFormat color_format;
-
-  VkImage image;
-  VmaAllocation allocation;
-  VkSampler sampler;
   VkImageView image_view;
-
   VkFramebuffer framebuffer;
-} canvas_t;
-
-static inline void create_color_target(canvas_t *canvas) {
-  VkImageCreateInfo imageCreateInfo = (VkImageCreateInfo){
-      VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-      NULL,
-      0,                    // flags
-      VK_IMAGE_TYPE_2D,     // imageType
-      canvas->color_format, // format
-      {
-          canvas->width,       // width
-          canvas->height,      // height
-          1,                   // depth
-      },                       // extent
-      1,                       // mipLevels
-      1,                       // arrayLayers
-      VK_SAMPLE_COUNT_1_BIT,   // samples
-      VK_IMAGE_TILING_OPTIMAL, // tiling
-      VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-          VK_IMAGE_USAGE_SAMPLED_BIT |
-          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, // usage
-      VK_SHARING_MODE_EXCLUSIVE,               // sharingMode
-      1,                                       // queueFamilyIndexCount
-      &g_graphics_queue_family_index,          // pQueueFamilyIndices
-      VK_IMAGE_LAYOUT_UNDEFINED,               // initialLayout
-  };
-
-  VmaAllocationCreateInfo imageAllocCreateInfo = {};
-  imageAllocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-  VK_CHECK(vmaCreateImage(
-      g_gpu_allocator,
-      &imageCreateInfo,
-      &imageAllocCreateInfo,
-      &canvas->image,
-      &canvas->allocation,
-      NULL));
-
-  VkImageViewCreateInfo imageViewCreateInfo = (VkImageViewCreateInfo){
-      VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-      NULL,
-      0,                     // flags
-      canvas->image,         // image
-      VK_IMAGE_VIEW_TYPE_2D, // viewType
-      canvas->color_format,  // format
-      {
-          VK_COMPONENT_SWIZZLE_IDENTITY, // r
-          VK_COMPONENT_SWIZZLE_IDENTITY, // g
-          VK_COMPONENT_SWIZZLE_IDENTITY, // b
-          VK_COMPONENT_SWIZZLE_IDENTITY, // a
-      },                                 // components
-      {
-          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
-          0,                         // baseMipLevel
-          1,                         // levelCount
-          0,                         // baseArrayLayer
-          1,                         // layerCount
-      },                             // subresourceRange
-  };
-
-  VK_CHECK(vkCreateImageView(
-      g_device, &imageViewCreateInfo, NULL, &canvas->image_view));
-
-  VkSamplerCreateInfo samplerCreateInfo = (VkSamplerCreateInfo){
-      VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-      NULL,
-      0,                                       // flags
-      VK_FILTER_LINEAR,                        // magFilter
-      VK_FILTER_LINEAR,                        // minFilter
-      VK_SAMPLER_MIPMAP_MODE_LINEAR,           // mipmapMode
-      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeU
-      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeV
-      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeW
-      0.0f,                                    // mipLodBias
-      VK_FALSE,                                // anisotropyEnable
-      1.0f,                                    // maxAnisotropy
-      VK_FALSE,                                // compareEnable
-      VK_COMPARE_OP_NEVER,                     // compareOp
-      0.0f,                                    // minLod
-      0.0f,                                    // maxLod
-      VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK, // borderColor
-      VK_FALSE,                                // unnormalizedCoordinates
-  };
-
-  VK_CHECK(
-      vkCreateSampler(g_device, &samplerCreateInfo, NULL, &canvas->sampler));
-}
-
-static inline void destroy_color_target(canvas_t *canvas) {
-  VK_CHECK(vkDeviceWaitIdle(g_device));
-
-  if (canvas->image != VK_NULL_HANDLE) {
-    vkDestroyImageView(g_device, canvas->image_view, NULL);
-  }
-
-  if (canvas->sampler != VK_NULL_HANDLE) {
-    vkDestroySampler(g_device, canvas->sampler, NULL);
-  }
-
-  if (canvas->image != VK_NULL_HANDLE) {
-    vmaDestroyImage(g_gpu_allocator, canvas->image, canvas->allocation);
+} cube_target_t;
+
+// LOAD keeps what was drawn by earlier passes, in which case the level has
+// to be in SHADER_READ_ONLY_OPTIMAL layout when a pass begins. Passes leave
+// it in that layout. DONT_CARE is for passes that overwrite the whole level.
+static inline void create_render_pass(
+    VkFormat color_format,
+    VkAttachmentLoadOp load_op,
+    VkRenderPass *render_pass) {
+  VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  if (load_op == VK_ATTACHMENT_LOAD_OP_LOAD) {
+    initial_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
   }
 
-  canvas->image = VK_NULL_HANDLE;
-  canvas->allocation = VK_NULL_HANDLE;
-  canvas->image_view = VK_NULL_HANDLE;
-  canvas->sampler = VK_NULL_HANDLE;
-}
-
-static inline void create_framebuffer(canvas_t *canvas) {
-  VkImageView attachments[] = {
-      canvas->image_view,
-  };
-
-  VkFramebufferCreateInfo createInfo = {
-      VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO, // sType
-      NULL,                                      // pNext
-      0,                                         // flags
-      canvas->render_pass,                       // renderPass
-      (uint32_t)ARRAYSIZE(attachments),          // attachmentCount
-      attachments,                               // pAttachments
-      canvas->width,                             // width
-      canvas->height,                            // height
-      1,                                         // layers
-  };
-
-  VK_CHECK(
-      vkCreateFramebuffer(g_device, &createInfo, NULL, &canvas->framebuffer));
-}
-
-static inline void destroy_framebuffer(canvas_t *canvas) {
-  VK_CHECK(vkDeviceWaitIdle(g_device));
-  vkDestroyFramebuffer(g_device, canvas->framebuffer, NULL);
-}
-
-static inline void create_render_pass(canvas_t *canvas) {
   VkAttachmentDescription attachmentDescriptions[] = {
       // Resolved color attachment
       (VkAttachmentDescription){
           0,                                        // flags
-          canvas->color_format,                     // format
+          color_format,                             // format
           VK_SAMPLE_COUNT_1_BIT,                    // samples
-          VK_ATTACHMENT_LOAD_OP_CLEAR,              // loadOp
+          load_op,                                  // loadOp
           VK_ATTACHMENT_STORE_OP_STORE,             // storeOp
           VK_ATTACHMENT_LOAD_OP_DONT_CARE,          // stencilLoadOp
           VK_ATTACHMENT_STORE_OP_DONT_CARE,         // stencilStoreOp
-          VK_IMAGE_LAYOUT_UNDEFINED,                // initialLayout
+          initial_layout,                           // initialLayout
           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, // finalLayout
       },
   };
@@ -1151,363 +1069,446 @@ static inline void create_render_pass(canvas_t *canvas) {
       dependencies,                                // pDependencies
   };
 
-  VK_CHECK(vkCreateRenderPass(
-      g_device, &renderPassCreateInfo, NULL, &canvas->render_pass));
+  VK_CHECK(
+      vkCreateRenderPass(g_device, &renderPassCreateInfo, NULL, render_pass));
 }
 
-static inline void destroy_render_pass(canvas_t *canvas) {
-  VK_CHECK(vkDeviceWaitIdle(g_device));
-  vkDestroyRenderPass(g_device, canvas->render_pass, NULL);
-}
+static void cube_target_init(
+    cube_target_t *target,
+    cubemap_t *cubemap,
+    uint32_t level,
+    VkRenderPass render_pass) {
+  target->width = cubemap->width >> level;
+  target->height = cubemap->height >> level;
 
-void canvas_init(
-    canvas_t *canvas,
-    const uint32_t width,
-    const uint32_t height,
-    const VkFormat color_format) {
-  canvas->width = width;
-  canvas->height = height;
-  canvas->color_format = color_format;
+  VkImageViewCreateInfo image_view_create_info = {
+      VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      NULL,
+      0,                           // flags
+      cubemap->image,              // image
+      VK_IMAGE_VIEW_TYPE_2D_ARRAY, // viewType
+      cubemap->format,             // format
+      {
+          VK_COMPONENT_SWIZZLE_IDENTITY, // r
+          VK_COMPONENT_SWIZZLE_IDENTITY, // g
+          VK_COMPONENT_SWIZZLE_IDENTITY, // b
+          VK_COMPONENT_SWIZZLE_IDENTITY, // a
+      },                                 // components
+      {
+          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+          level,                     // baseMipLevel
+          1,                         // levelCount
+          0,                         // baseArrayLayer
+          CUBE_FACE_COUNT,           // layerCount
+      },                             // subresourceRange
+  };
+
+  VK_CHECK(vkCreateImageView(
+      g_device, &image_view_create_info, NULL, &target->image_view));
+
+  // Compute bakes only need the view
+  target->framebuffer = VK_NULL_HANDLE;
+  if (render_pass == VK_NULL_HANDLE) {
+    return;
+  }
+
+  VkImageView attachments[] = {
+      target->image_view,
+  };
+
+  VkFramebufferCreateInfo framebuffer_create_info = {
+      VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO, // sType
+      NULL,                                      // pNext
+      0,                                         // flags
+      render_pass,                               // renderPass
+      (uint32_t)ARRAYSIZE(attachments),          // attachmentCount
+      attachments,                               // pAttachments
+      target->width,                             // width
+      target->height,                            // height
+      CUBE_FACE_COUNT,                           // layers
+  };
 
-  create_color_target(canvas);
-  create_render_pass(canvas);
-  create_framebuffer(canvas);
+  VK_CHECK(vkCreateFramebuffer(
+      g_device, &framebuffer_create_info, NULL, &target->framebuffer));
 }
 
-void canvas_begin(canvas_t *canvas, const VkCommandBuffer command_buffer) {
-  VkClearValue clearValues[2] = {};
-  clearValues[0].color = (VkClearColorValue){{0.0f, 0.0f, 0.0f, 1.0f}};
-  clearValues[1].depthStencil = (VkClearDepthStencilValue){1.0f, 0};
+// Any render pass compatible with the one the target was created with can be
+// used, they only differ in load op and layouts
+static void cube_target_begin(
+    cube_target_t *target,
+    VkRenderPass render_pass,
+    VkCommandBuffer command_buffer) {
+  VkClearValue clear_value;
+  clear_value.color = (VkClearColorValue){{0.0f, 0.0f, 0.0f, 1.0f}};
 
-  VkRenderPassBeginInfo renderPassBeginInfo = {
+  VkRenderPassBeginInfo render_pass_begin_info = {
       VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,  // sType
       NULL,                                      // pNext
-      canvas->render_pass,                       // renderPass
-      canvas->framebuffer,                       // framebuffer
-      {{0, 0}, {canvas->width, canvas->height}}, // renderArea
-      ARRAYSIZE(clearValues),                    // clearValueCount
-      clearValues,                               // pClearValues
+      render_pass,                               // renderPass
+      target->framebuffer,                       // framebuffer
+      {{0, 0}, {target->width, target->height}}, // renderArea
+      1,                                         // clearValueCount
+      &clear_value,                              // pClearValues
   };
 
   vkCmdBeginRenderPass(
-      command_buffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+      command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
   VkViewport viewport = (VkViewport){
       0.0f,                  // x
       0.0f,                  // y
-      (float)canvas->width,  // width
-      (float)canvas->height, // height
+      (float)target->width,  // width
+      (float)target->height, // height
       0.0f,                  // minDepth
       1.0f,                  // maxDepth
   };
 
   vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
-  VkRect2D scissor = (VkRect2D){{0, 0}, {canvas->width, canvas->height}};
+  VkRect2D scissor = (VkRect2D){{0, 0}, {target->width, target->height}};
 
   vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 }
 
-void canvas_end(canvas_t *canvas, const VkCommandBuffer command_buffer) {
+static void cube_target_end(VkCommandBuffer command_buffer) {
   vkCmdEndRenderPass(command_buffer);
 }
 
-void canvas_destroy(canvas_t *canvas) {
-  destroy_framebuffer(canvas);
-  destroy_render_pass(canvas);
-  destroy_color_target(canvas);
+static void cube_target_destroy(cube_target_t *target) {
+  VK_CHECK(vkDeviceWaitIdle(g_device));
+
+  vkDestroyFramebuffer(g_device, target->framebuffer, NULL);
+  vkDestroyImageView(g_device, target->image_view, NULL);
+
+  target->framebuffer = VK_NULL_HANDLE;
+  target->image_view = VK_NULL_HANDLE;
 }
 
 /*
  *
- * Cubemap stuff
+ * Pipeline stuff
  *
  */
 
-static void create_image_and_image_view(
-    VkImage *image,
-    VmaAllocation *allocation,
-    VkImageView *image_view,
-    VkFormat format,
-    uint32_t width,
-    uint32_t height,
-    VkImageUsageFlags usage) {
-  VkImageCreateInfo image_create_info = {
-      VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-      NULL,
-      0,                // flags
-      VK_IMAGE_TYPE_2D, // imageType
-      format,           // format
-      {
-          width,                      // width
-          height,                     // height
-          1,                          // depth
-      },                              // extent
-      1,                              // mipLevels
-      1,                              // arrayLayers
-      VK_SAMPLE_COUNT_1_BIT,          // samples
-      VK_IMAGE_TILING_OPTIMAL,        // tiling
-      usage,                          // usage
-      VK_SHARING_MODE_EXCLUSIVE,      // sharingMode
-      1,                              // queueFamilyIndexCount
-      &g_graphics_queue_family_index, // pQueueFamilyIndices
-      VK_IMAGE_LAYOUT_UNDEFINED,      // initialLayout
-  };
+typedef enum bake_pipeline_t {
+  BAKE_PIPELINE_SKYBOX,
+  BAKE_PIPELINE_SKYBOX_RGBE,
+  BAKE_PIPELINE_IRRADIANCE,
+  BAKE_PIPELINE_RADIANCE,
+  BAKE_PIPELINE_COUNT,
+} bake_pipeline_t;
+
+// Where the SPIR-V is, which the build compiles into its shaders directory
+// and passes here as an absolute path
+#ifndef BAKE_SHADER_DIR
+#define BAKE_SHADER_DIR "shaders"
+#endif
 
-  VmaAllocationCreateInfo image_alloc_create_info = {};
-  image_alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+// Vertex, geometry and fragment shader of every pipeline
+const char *const BAKE_PIPELINE_SHADER_PATHS[BAKE_PIPELINE_COUNT][3] = {
+    [BAKE_PIPELINE_SKYBOX] =
+        {
+            BAKE_SHADER_DIR "/fullscreen_triangle.vert.spv",
+            BAKE_SHADER_DIR "/cube_faces.geom.spv",
+            BAKE_SHADER_DIR "/skybox.frag.spv",
+        },
+    [BAKE_PIPELINE_SKYBOX_RGBE] =
+        {
+            BAKE_SHADER_DIR "/fullscreen_triangle.vert.spv",
+            BAKE_SHADER_DIR "/cube_faces.geom.spv",
+            BAKE_SHADER_DIR "/skybox_rgbe.frag.spv",
+        },
+    [BAKE_PIPELINE_IRRADIANCE] =
+        {
+            BAKE_SHADER_DIR "/fullscreen_triangle.vert.spv",
+            BAKE_SHADER_DIR "/cube_faces.geom.spv",
+            BAKE_SHADER_DIR "/irradiance.frag.spv",
+        },
+    [BAKE_PIPELINE_RADIANCE] =
+        {
+            BAKE_SHADER_DIR "/fullscreen_triangle.vert.spv",
+            BAKE_SHADER_DIR "/cube_faces.geom.spv",
+            BAKE_SHADER_DIR "/radiance.frag.spv",
+        },
+};
 
-  VK_CHECK(vmaCreateImage(
-      g_gpu_allocator,
-      &image_create_info,
-      &image_alloc_create_info,
-      image,
-      allocation,
-      NULL));
+// Compute shader of every pipeline, for the compute backend
+const char *const BAKE_PIPELINE_COMPUTE_SHADER_PATHS[BAKE_PIPELINE_COUNT] = {
+    [BAKE_PIPELINE_SKYBOX] = BAKE_SHADER_DIR "/skybox.comp.spv",
+    [BAKE_PIPELINE_SKYBOX_RGBE] = BAKE_SHADER_DIR "/skybox_rgbe.comp.spv",
+    [BAKE_PIPELINE_IRRADIANCE] = BAKE_SHADER_DIR "/irradiance.comp.spv",
+    [BAKE_PIPELINE_RADIANCE] = BAKE_SHADER_DIR "/radiance.comp.spv",
+};
 
-  VkImageViewCreateInfo image_view_create_info = {
-      VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+// Compute workgroups cover a square of texels of one face. The size is
+// handed to the shaders as specialization constants.
+#define BAKE_COMPUTE_GROUP_SIZE 8
+
+typedef struct shader_code_t {
+  unsigned char *code;
+  size_t size;
+} shader_code_t;
+
+// All pipelines of a backend share one layout. The compute backend has its
+// own descriptor set layout, with the storage image it writes.
+bake_backend_t g_bake_backend = BAKE_BACKEND_GRAPHICS;
+VkPipelineBindPoint g_bake_pipeline_bind_point;
+VkShaderStageFlags g_bake_push_constant_stages;
+
+VkDescriptorSetLayout g_bake_compute_descriptor_set_layout = VK_NULL_HANDLE;
+VkPipelineLayout g_bake_pipeline_layout = VK_NULL_HANDLE;
+VkPipeline g_bake_pipelines[BAKE_PIPELINE_COUNT];
+
+// Reads the SPIR-V of every pipeline of the backend, in stage order, leaving
+// unused stages empty. Doesn't need a device, so it can run before or during
+// vulkan_setup.
+static void load_bake_shaders(
+    shader_code_t codes[BAKE_PIPELINE_COUNT][3], bake_backend_t backend) {
+  for (uint32_t i = 0; i < BAKE_PIPELINE_COUNT; i++) {
+    for (uint32_t stage = 0; stage < 3; stage++) {
+      const char *path = NULL;
+      if (backend == BAKE_BACKEND_GRAPHICS) {
+        path = BAKE_PIPELINE_SHADER_PATHS[i][stage];
+      } else if (stage == 0) {
+        path = BAKE_PIPELINE_COMPUTE_SHADER_PATHS[i];
+      }
+
+      codes[i][stage] = (shader_code_t){};
+      if (path == NULL) {
+        continue;
+      }
+
+      codes[i][stage].code =
+          load_bytes_from_file(path, &codes[i][stage].size);
+      if (codes[i][stage].code == NULL) {
+        printf("Failed to load shader %s, is glslc installed?\n", path);
+        abort();
+      }
+    }
+  }
+}
+
+static VkShaderModule create_shader_module(const shader_code_t *code) {
+  VkShaderModuleCreateInfo create_info = {
+      VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
       NULL,
-      0,                     // flags
-      *image,                // image
-      VK_IMAGE_VIEW_TYPE_2D, // viewType
-      format,                // format
+      0,
+      code->size,
+      (uint32_t *)code->code};
+
+  VkShaderModule module;
+  VK_CHECK(vkCreateShaderModule(g_device, &create_info, NULL, &module));
+  return module;
+}
+
+static void
+create_bake_graphics_pipelines(shader_code_t codes[BAKE_PIPELINE_COUNT][3]) {
+  // Pipelines only need a compatible render pass, and all cube targets have
+  // the same single float attachment
+  VkRenderPass render_pass;
+  create_render_pass(
+      VK_FORMAT_R32G32B32A32_SFLOAT, VK_ATTACHMENT_LOAD_OP_CLEAR, &render_pass);
+
+  for (uint32_t i = 0; i < BAKE_PIPELINE_COUNT; i++) {
+    VkShaderModule vertex_module = create_shader_module(&codes[i][0]);
+    VkShaderModule geometry_module = create_shader_module(&codes[i][1]);
+    VkShaderModule fragment_module = create_shader_module(&codes[i][2]);
+
+    VkGraphicsPipelineCreateInfo pipeline_create_info =
+        default_pipeline_create_info(
+            vertex_module,
+            geometry_module,
+            fragment_module,
+            g_bake_pipeline_layout,
+            render_pass);
+
+    VK_CHECK(vkCreateGraphicsPipelines(
+        g_device,
+        VK_NULL_HANDLE,
+        1,
+        &pipeline_create_info,
+        NULL,
+        &g_bake_pipelines[i]));
+
+    vkDestroyShaderModule(g_device, vertex_module, NULL);
+    vkDestroyShaderModule(g_device, geometry_module, NULL);
+    vkDestroyShaderModule(g_device, fragment_module, NULL);
+  }
+
+  vkDestroyRenderPass(g_device, render_pass, NULL);
+}
+
+static void
+create_bake_compute_pipelines(shader_code_t codes[BAKE_PIPELINE_COUNT][3]) {
+  VkSpecializationMapEntry specialization_entries[] = {
       {
-          VK_COMPONENT_SWIZZLE_IDENTITY, // r
-          VK_COMPONENT_SWIZZLE_IDENTITY, // g
-          VK_COMPONENT_SWIZZLE_IDENTITY, // b
-          VK_COMPONENT_SWIZZLE_IDENTITY, // a
-      },                                 // components
+          0,                // constantID
+          0,                // offset
+          sizeof(uint32_t), // size
+      },
       {
-          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
-          0,                         // baseMipLevel
-          1,                         // levelCount
-          0,                         // baseArrayLayer
-          1,                         // layerCount
-      },                             // subresourceRange
+          1,                // constantID
+          sizeof(uint32_t), // offset
+          sizeof(uint32_t), // size
+      },
   };
 
-  VK_CHECK(
-      vkCreateImageView(g_device, &image_view_create_info, NULL, image_view));
-}
+  uint32_t group_size[2] = {BAKE_COMPUTE_GROUP_SIZE, BAKE_COMPUTE_GROUP_SIZE};
 
-static void create_sampler(VkSampler *sampler) {
-  VkSamplerCreateInfo sampler_create_info = {
-      VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-      NULL,
-      0,                                       // flags
-      VK_FILTER_LINEAR,                        // magFilter
-      VK_FILTER_LINEAR,                        // minFilter
-      VK_SAMPLER_MIPMAP_MODE_LINEAR,           // mipmapMode
-      VK_SAMPLER_ADDRESS_MODE_REPEAT,          // addressModeU
-      VK_SAMPLER_ADDRESS_MODE_REPEAT,          // addressModeV
-      VK_SAMPLER_ADDRESS_MODE_REPEAT,          // addressModeW
-      0.0f,                                    // mipLodBias
-      VK_FALSE,                                // anisotropyEnable
-      1.0f,                                    // maxAnisotropy
-      VK_FALSE,                                // compareEnable
-      VK_COMPARE_OP_NEVER,                     // compareOp
-      0.0f,                                    // minLod
-      0.0f,                                    // maxLod
-      VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK, // borderColor
-      VK_FALSE,                                // unnormalizedCoordinates
+  VkSpecializationInfo specialization_info = {
+      (uint32_t)ARRAYSIZE(specialization_entries), // mapEntryCount
+      specialization_entries,                      // pMapEntries
+      sizeof(group_size),                          // dataSize
+      group_size,                                  // pData
   };
 
-  VK_CHECK(vkCreateSampler(g_device, &sampler_create_info, NULL, sampler));
-}
-
-static void copy_side_image_to_cubemap(
-    VkCommandBuffer command_buffer,
-    VkImage side_image,
-    cubemap_t *cubemap,
-    uint32_t layer,
-    uint32_t level) {
-  VkImageSubresourceRange side_image_subresource_range = {};
-  side_image_subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  side_image_subresource_range.baseMipLevel = 0;
-  side_image_subresource_range.levelCount = 1;
-  side_image_subresource_range.baseArrayLayer = 0;
-  side_image_subresource_range.layerCount = 1;
-
-  set_image_layout(
-      command_buffer,
-      side_image,
-      VK_IMAGE_LAYOUT_UNDEFINED,
-      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      side_image_subresource_range,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-
-  VkImageSubresourceRange cube_face_subresource_range = {};
-  cube_face_subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  cube_face_subresource_range.baseMipLevel = level;
-  cube_face_subresource_range.levelCount = 1;
-  cube_face_subresource_range.baseArrayLayer = layer;
-  cube_face_subresource_range.layerCount = 1;
+  for (uint32_t i = 0; i < BAKE_PIPELINE_COUNT; i++) {
+    VkShaderModule compute_module = create_shader_module(&codes[i][0]);
 
-  set_image_layout(
-      command_buffer,
-      cubemap->image,
-      VK_IMAGE_LAYOUT_UNDEFINED,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      cube_face_subresource_range,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-
-  VkImageCopy copy_region = {};
-
-  copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  copy_region.srcSubresource.baseArrayLayer = 0;
-  copy_region.srcSubresource.mipLevel = 0;
-  copy_region.srcSubresource.layerCount = 1;
-  copy_region.srcOffset = (VkOffset3D){0, 0, 0};
-
-  copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  copy_region.dstSubresource.baseArrayLayer = layer;
-  copy_region.dstSubresource.mipLevel = level;
-  copy_region.dstSubresource.layerCount = 1;
-  copy_region.dstOffset = (VkOffset3D){0, 0, 0};
-
-  copy_region.extent.width = (uint32_t)(cubemap->width / pow(2, level));
-  copy_region.extent.height = (uint32_t)(cubemap->height / pow(2, level));
-  copy_region.extent.depth = 1;
-
-  // Put image copy into command buffer
-  vkCmdCopyImage(
-      command_buffer,
-      side_image,
-      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      cubemap->image,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      1,
-      &copy_region);
+    VkComputePipelineCreateInfo pipeline_create_info = {
+        VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, // sType
+        NULL,                                           // pNext
+        0,                                              // flags
+        {
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType
+            NULL,                                                // pNext
+            0,                                                   // flags
+            VK_SHADER_STAGE_COMPUTE_BIT,                         // stage
+            compute_module,                                      // module
+            "main",                                              // pName
+            &specialization_info, // pSpecializationInfo
+        },                        // stage
+        g_bake_pipeline_layout,   // layout
+        VK_NULL_HANDLE,           // basePipelineHandle
+        -1,                       // basePipelineIndex
+    };
 
-  // Transform framebuffer color attachment back
-  set_image_layout(
-      command_buffer,
-      side_image,
-      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-      side_image_subresource_range,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    VK_CHECK(vkCreateComputePipelines(
+        g_device,
+        VK_NULL_HANDLE,
+        1,
+        &pipeline_create_info,
+        NULL,
+        &g_bake_pipelines[i]));
 
-  // Change image layout of copied face to shader read
-  set_image_layout(
-      command_buffer,
-      cubemap->image,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-      cube_face_subresource_range,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    vkDestroyShaderModule(g_device, compute_module, NULL);
+  }
 }
 
-static void render_equirec_to_cubemap(
-    const char *hdr_file,
-    cubemap_t *dest_cubemap,
-    uint32_t level,
-    const char *vert_path,
-    const char *frag_path) {
-  // Load HDR image
-  int hdr_width, hdr_height, nr_components;
-  float *hdr_data =
-      stbi_loadf(hdr_file, &hdr_width, &hdr_height, &nr_components, 4);
-
-  assert(hdr_data != NULL);
+static void create_bake_compute_descriptor_set_layout() {
+  VkDescriptorSetLayoutBinding bindings[] = {
+      {
+          0,                                         // binding
+          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // descriptorType
+          1,                                         // descriptorCount
+          VK_SHADER_STAGE_COMPUTE_BIT,               // stageFlags
+          NULL,                                      // pImmutableSamplers
+      },
+      {
+          1,                                // binding
+          VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // descriptorType
+          1,                                // descriptorCount
+          VK_SHADER_STAGE_COMPUTE_BIT,      // stageFlags
+          NULL,                             // pImmutableSamplers
+      },
+      {
+          BAKE_SAMPLES_BINDING,              // binding
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // descriptorType
+          1,                                 // descriptorCount
+          VK_SHADER_STAGE_COMPUTE_BIT,       // stageFlags
+          NULL,                              // pImmutableSamplers
+      },
+  };
 
-  // Create HDR VkImage and stuff
-  VkImage hdr_image = VK_NULL_HANDLE;
-  VmaAllocation hdr_allocation = VK_NULL_HANDLE;
-  VkImageView hdr_image_view = VK_NULL_HANDLE;
-  VkSampler hdr_sampler = VK_NULL_HANDLE;
+  VkDescriptorSetLayoutCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  create_info.pNext = NULL;
+  create_info.flags = 0;
+  create_info.bindingCount = ARRAYSIZE(bindings);
+  create_info.pBindings = bindings;
 
-  create_image_and_image_view(
-      &hdr_image,
-      &hdr_allocation,
-      &hdr_image_view,
-      dest_cubemap->format,
-      (uint32_t)hdr_width,
-      (uint32_t)hdr_height,
-      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+  VK_CHECK(vkCreateDescriptorSetLayout(
+      g_device, &create_info, NULL, &g_bake_compute_descriptor_set_layout));
+}
 
-  create_sampler(&hdr_sampler);
+// Compiles every pipeline of the backend up front, so none of it is left for
+// the render functions. Takes ownership of the shader codes.
+static void create_bake_pipelines(
+    shader_code_t codes[BAKE_PIPELINE_COUNT][3], bake_backend_t backend) {
+  g_bake_backend = backend;
 
-  // Upload data to image
-  {
-    size_t hdr_size = hdr_width * hdr_height * 4 * sizeof(float);
+  VkDescriptorSetLayout set_layout = g_bake_cubemap_descriptor_set_layout;
+  if (backend == BAKE_BACKEND_GRAPHICS) {
+    g_bake_pipeline_bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    g_bake_push_constant_stages = VK_SHADER_STAGE_FRAGMENT_BIT;
+  } else {
+    g_bake_pipeline_bind_point = VK_PIPELINE_BIND_POINT_COMPUTE;
+    g_bake_push_constant_stages = VK_SHADER_STAGE_COMPUTE_BIT;
 
-    VkBuffer staging_buffer;
-    VmaAllocation staging_allocation;
+    create_bake_compute_descriptor_set_layout();
+    set_layout = g_bake_compute_descriptor_set_layout;
+  }
 
-    create_buffer(
-        &staging_buffer,
-        &staging_allocation,
-        hdr_size,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VMA_MEMORY_USAGE_CPU_ONLY,
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VkPushConstantRange push_constant_range = {};
+  push_constant_range.stageFlags = g_bake_push_constant_stages;
+  push_constant_range.offset = 0;
+  push_constant_range.size = 128;
 
-    void *stagingMemoryPointer;
-    vmaMapMemory(g_gpu_allocator, staging_allocation, &stagingMemoryPointer);
-    memcpy(stagingMemoryPointer, hdr_data, hdr_size);
+  VkPipelineLayoutCreateInfo create_info;
+  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  create_info.pNext = NULL;
+  create_info.flags = 0;
+  create_info.setLayoutCount = 1;
+  create_info.pSetLayouts = &set_layout;
+  create_info.pushConstantRangeCount = 1;
+  create_info.pPushConstantRanges = &push_constant_range;
 
-    VkCommandBuffer command_buffer = begin_single_time_command_buffer();
+  VK_CHECK(vkCreatePipelineLayout(
+      g_device, &create_info, NULL, &g_bake_pipeline_layout));
 
-    VkImageSubresourceRange subresource_range = {};
-    subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    subresource_range.baseMipLevel = 0;
-    subresource_range.levelCount = 1;
-    subresource_range.baseArrayLayer = 0;
-    subresource_range.layerCount = 1;
+  if (backend == BAKE_BACKEND_GRAPHICS) {
+    create_bake_graphics_pipelines(codes);
+  } else {
+    create_bake_compute_pipelines(codes);
+  }
 
-    set_image_layout(
-        command_buffer,
-        hdr_image,
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        subresource_range,
-        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+  for (uint32_t i = 0; i < BAKE_PIPELINE_COUNT; i++) {
+    for (uint32_t stage = 0; stage < 3; stage++) {
+      free(codes[i][stage].code);
+    }
+  }
+}
 
-    VkBufferImageCopy region = (VkBufferImageCopy){
-        0, // bufferOffset
-        0, // bufferRowLength
-        0, // bufferImageHeight
-        {
-            VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
-            0,                         // mipLevel
-            0,                         // baseArrayLayer
-            1,                         // layerCount
-        },                             // imageSubresource
-        {0, 0, 0},                     // imageOffset
-        {hdr_width, hdr_height, 1},    // imageExtent
-    };
+static void destroy_bake_pipelines() {
+  VK_CHECK(vkDeviceWaitIdle(g_device));
 
-    vkCmdCopyBufferToImage(
-        command_buffer,
-        staging_buffer,
-        hdr_image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &region);
+  for (uint32_t i = 0; i < BAKE_PIPELINE_COUNT; i++) {
+    vkDestroyPipeline(g_device, g_bake_pipelines[i], NULL);
+  }
 
-    set_image_layout(
-        command_buffer,
-        hdr_image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range,
-        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+  vkDestroyPipelineLayout(g_device, g_bake_pipeline_layout, NULL);
 
-    end_single_time_command_buffer(command_buffer);
+  if (g_bake_compute_descriptor_set_layout != VK_NULL_HANDLE) {
+    vkDestroyDescriptorSetLayout(
+        g_device, g_bake_compute_descriptor_set_layout, NULL);
+    g_bake_compute_descriptor_set_layout = VK_NULL_HANDLE;
+  }
+}
 
-    VK_CHECK(vkDeviceWaitIdle(g_device));
-    vmaDestroyBuffer(g_gpu_allocator, staging_buffer, staging_allocation);
+// Allocates the descriptor set a bake pipeline reads source_view through.
+// The compute backend also writes storage_view, a 2D array view of the
+// level being baked. samples is the precomputed sample table of the stage,
+// or VK_NULL_HANDLE if it doesn't use one.
+static VkDescriptorSet allocate_bake_descriptor_set(
+    VkSampler sampler,
+    VkImageView source_view,
+    VkImageView storage_view,
+    VkBuffer samples) {
+  VkDescriptorSetLayout set_layout = g_bake_cubemap_descriptor_set_layout;
+  if (g_bake_backend == BAKE_BACKEND_COMPUTE) {
+    set_layout = g_bake_compute_descriptor_set_layout;
   }
 
-  // Create hdrDescriptorSet
   VkDescriptorSet descriptor_set;
   {
     VkDescriptorSetAllocateInfo alloc_info = {};
@@ -1515,118 +1516,1082 @@ static void render_equirec_to_cubemap(
     alloc_info.pNext = NULL;
     alloc_info.descriptorPool = g_descriptor_pool;
     alloc_info.descriptorSetCount = 1;
-    alloc_info.pSetLayouts = &g_bake_cubemap_descriptor_set_layout;
+    alloc_info.pSetLayouts = &set_layout;
 
     VK_CHECK(vkAllocateDescriptorSets(g_device, &alloc_info, &descriptor_set));
   }
 
-  {
-    VkDescriptorImageInfo image_descriptor = {
-        hdr_sampler,
-        hdr_image_view,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-    };
-
-    VkWriteDescriptorSet descriptor_write = {
-        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        NULL,
-        descriptor_set,                            // dstSet
-        0,                                         // dstBinding
-        0,                                         // dstArrayElement
-        1,                                         // descriptorCount
-        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // descriptorType
-        &image_descriptor,                         // pImageInfo
-        NULL,                                      // pBufferInfo
-        NULL,                                      // pTexelBufferView
-    };
-
-    vkUpdateDescriptorSets(g_device, 1, &descriptor_write, 0, NULL);
-  }
-
-  // Camera matrices
-  push_constant_t pc;
-  mat4_t proj = mat4_perspective(to_radians(90.0f), 1.0f, 0.1f, 10.0f);
+  VkDescriptorImageInfo image_descriptor = {
+      sampler,
+      source_view,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+  };
 
-  canvas_t canvas;
-  canvas_init(
-      &canvas, dest_cubemap->width, dest_cubemap->height, dest_cubemap->format);
+  VkDescriptorImageInfo storage_descriptor = {
+      VK_NULL_HANDLE,
+      storage_view,
+      VK_IMAGE_LAYOUT_GENERAL,
+  };
 
-  // Create pipeline
-  VkShaderModule vertex_module;
-  VkShaderModule fragment_module;
+  VkDescriptorBufferInfo samples_descriptor = {
+      samples,       // buffer
+      0,             // offset
+      VK_WHOLE_SIZE, // range
+  };
 
-  size_t vertex_code_size;
-  unsigned char *vertex_code =
-      load_bytes_from_file(vert_path, &vertex_code_size);
+  VkWriteDescriptorSet descriptor_writes[3];
+  uint32_t write_count = 0;
 
-  size_t fragment_code_size;
-  unsigned char *fragment_code =
-      load_bytes_from_file(frag_path, &fragment_code_size);
+  descriptor_writes[write_count++] = (VkWriteDescriptorSet){
+      VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      NULL,
+      descriptor_set,                            // dstSet
+      0,                                         // dstBinding
+      0,                                         // dstArrayElement
+      1,                                         // descriptorCount
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // descriptorType
+      &image_descriptor,                         // pImageInfo
+      NULL,                                      // pBufferInfo
+      NULL,                                      // pTexelBufferView
+  };
 
-  // Vertex module
-  {
-    VkShaderModuleCreateInfo create_info = {
-        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+  if (g_bake_backend == BAKE_BACKEND_COMPUTE) {
+    descriptor_writes[write_count++] = (VkWriteDescriptorSet){
+        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         NULL,
-        0,
-        vertex_code_size,
-        (uint32_t *)vertex_code};
-
-    VK_CHECK(
-        vkCreateShaderModule(g_device, &create_info, NULL, &vertex_module));
+        descriptor_set,                   // dstSet
+        1,                                // dstBinding
+        0,                                // dstArrayElement
+        1,                                // descriptorCount
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // descriptorType
+        &storage_descriptor,              // pImageInfo
+        NULL,                             // pBufferInfo
+        NULL,                             // pTexelBufferView
+    };
   }
 
-  // Fragment module
-  {
-    VkShaderModuleCreateInfo create_info = {
-        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+  if (samples != VK_NULL_HANDLE) {
+    descriptor_writes[write_count++] = (VkWriteDescriptorSet){
+        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         NULL,
-        0,
-        fragment_code_size,
-        (uint32_t *)fragment_code};
-
-    VK_CHECK(
-        vkCreateShaderModule(g_device, &create_info, NULL, &fragment_module));
+        descriptor_set,                    // dstSet
+        BAKE_SAMPLES_BINDING,              // dstBinding
+        0,                                 // dstArrayElement
+        1,                                 // descriptorCount
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // descriptorType
+        NULL,                              // pImageInfo
+        &samples_descriptor,               // pBufferInfo
+        NULL,                              // pTexelBufferView
+    };
   }
 
-  free(vertex_code);
-  free(fragment_code);
+  vkUpdateDescriptorSets(g_device, write_count, descriptor_writes, 0, NULL);
 
-  VkDescriptorSetLayout set_layouts[] = {
-      g_bake_cubemap_descriptor_set_layout,
-  };
+  return descriptor_set;
+}
 
-  VkPipelineLayout pipeline_layout;
+// Bakes a whole cubemap level with the compute backend, one invocation per
+// texel and the six faces along z
+static void dispatch_bake_level(
+    VkCommandBuffer command_buffer, uint32_t width, uint32_t height) {
+  vkCmdDispatch(
+      command_buffer,
+      (width + BAKE_COMPUTE_GROUP_SIZE - 1) / BAKE_COMPUTE_GROUP_SIZE,
+      (height + BAKE_COMPUTE_GROUP_SIZE - 1) / BAKE_COMPUTE_GROUP_SIZE,
+      CUBE_FACE_COUNT);
+}
 
-  VkPushConstantRange push_constant_range = {};
-  push_constant_range.stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-  push_constant_range.offset = 0;
-  push_constant_range.size = 128;
+/*
+ *
+ * Cubemap stuff
+ *
+ */
 
-  VkPipelineLayoutCreateInfo create_info;
-  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  create_info.pNext = NULL;
-  create_info.flags = 0;
-  create_info.setLayoutCount = ARRAYSIZE(set_layouts);
-  create_info.pSetLayouts = set_layouts;
-  create_info.pushConstantRangeCount = 1;
-  create_info.pPushConstantRanges = &push_constant_range;
+static void create_image_and_image_view(
+    VkImage *image,
+    VmaAllocation *allocation,
+    VkImageView *image_view,
+    VkFormat format,
+    uint32_t width,
+    uint32_t height,
+    VkImageUsageFlags usage) {
+  VkImageCreateInfo image_create_info = {
+      VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      NULL,
+      0,                // flags
+      VK_IMAGE_TYPE_2D, // imageType
+      format,           // format
+      {
+          width,                      // width
+          height,                     // height
+          1,                          // depth
+      },                              // extent
+      1,                              // mipLevels
+      1,                              // arrayLayers
+      VK_SAMPLE_COUNT_1_BIT,          // samples
+      VK_IMAGE_TILING_OPTIMAL,        // tiling
+      usage,                          // usage
+      VK_SHARING_MODE_EXCLUSIVE,      // sharingMode
+      1,                              // queueFamilyIndexCount
+      &g_graphics_queue_family_index, // pQueueFamilyIndices
+      VK_IMAGE_LAYOUT_UNDEFINED,      // initialLayout
+  };
 
-  VK_CHECK(
-      vkCreatePipelineLayout(g_device, &create_info, NULL, &pipeline_layout));
+  VmaAllocationCreateInfo image_alloc_create_info = {};
+  image_alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-  VkPipeline pipeline;
+  VK_CHECK(vmaCreateImage(
+      g_gpu_allocator,
+      &image_create_info,
+      &image_alloc_create_info,
+      image,
+      allocation,
+      NULL));
 
-  VkGraphicsPipelineCreateInfo pipeline_create_info =
-      default_pipeline_create_info(
-          vertex_module, fragment_module, pipeline_layout, canvas.render_pass);
+  VkImageViewCreateInfo image_view_create_info = {
+      VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      NULL,
+      0,                     // flags
+      *image,                // image
+      VK_IMAGE_VIEW_TYPE_2D, // viewType
+      format,                // format
+      {
+          VK_COMPONENT_SWIZZLE_IDENTITY, // r
+          VK_COMPONENT_SWIZZLE_IDENTITY, // g
+          VK_COMPONENT_SWIZZLE_IDENTITY, // b
+          VK_COMPONENT_SWIZZLE_IDENTITY, // a
+      },                                 // components
+      {
+          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+          0,                         // baseMipLevel
+          1,                         // levelCount
+          0,                         // baseArrayLayer
+          1,                         // layerCount
+      },                             // subresourceRange
+  };
 
-  VK_CHECK(vkCreateGraphicsPipelines(
-      g_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &pipeline));
+  VK_CHECK(
+      vkCreateImageView(g_device, &image_view_create_info, NULL, image_view));
+}
 
-  // Allocate command buffer
-  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+static void create_sampler(VkSampler *sampler, VkFilter filter) {
+  VkSamplerCreateInfo sampler_create_info = {
+      VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+      NULL,
+      0,                                       // flags
+      filter,                                  // magFilter
+      filter,                                  // minFilter
+      VK_SAMPLER_MIPMAP_MODE_LINEAR,           // mipmapMode
+      VK_SAMPLER_ADDRESS_MODE_REPEAT,          // addressModeU
+      VK_SAMPLER_ADDRESS_MODE_REPEAT,          // addressModeV
+      VK_SAMPLER_ADDRESS_MODE_REPEAT,          // addressModeW
+      0.0f,                                    // mipLodBias
+      VK_FALSE,                                // anisotropyEnable
+      1.0f,                                    // maxAnisotropy
+      VK_FALSE,                                // compareEnable
+      VK_COMPARE_OP_NEVER,                     // compareOp
+      0.0f,                                    // minLod
+      0.0f,                                    // maxLod
+      VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK, // borderColor
+      VK_FALSE,                                // unnormalizedCoordinates
+  };
+
+  VK_CHECK(vkCreateSampler(g_device, &sampler_create_info, NULL, sampler));
+}
+
+// Largest equirect tile uploaded at once. Panoramas that don't fit in one tile
+// are uploaded and rendered a tile at a time, so device memory use doesn't
+// grow with the input size. Vulkan guarantees maxImageDimension2D is at
+// least 4096, so this is known before there is a device.
+#define EQUIREC_TILE_SIZE_MAX 4096
+
+typedef enum skybox_layout_t {
+  SKYBOX_LAYOUT_EQUIREC,
+  SKYBOX_LAYOUT_HORIZONTAL_CROSS,
+  SKYBOX_LAYOUT_VERTICAL_CROSS,
+  // Six face images packed one after another
+  SKYBOX_LAYOUT_FACES,
+} skybox_layout_t;
+
+// Position of every face in a cube cross, in face sizes, in cubemap layer
+// order: +X, -X, +Y, -Y, +Z, -Z
+const uint32_t HORIZONTAL_CROSS_CELLS[6][2] = {
+    {2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {3, 1},
+};
+const uint32_t VERTICAL_CROSS_CELLS[6][2] = {
+    {2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {1, 3},
+};
+
+// What stands for %s in the path of a six face input, in layer order
+const char *const CUBE_FACE_NAMES[6] = {"px", "nx", "py", "ny", "pz", "nz"};
+
+// Skybox image read from disk, ready to be uploaded
+typedef struct skybox_source_t {
+  const char *path;
+  skybox_layout_t layout;
+  uint32_t width;
+  uint32_t height;
+
+  // How the pixels are uploaded, and how Radiance files are decoded
+  VkFormat format;
+  size_t texel_size;
+  hdr_pixel_format_t pixel_format;
+
+  // Face size of cube layouts, which are copied straight into the skybox
+  uint32_t face_size;
+
+  // The whole image, unless it is a Radiance equirect uploaded as it is.
+  // Those that fit in one tile are decoded straight into a staging buffer
+  // handed over by the main thread. The others, or all of them when loading
+  // isn't threaded, are kept open and decoded while uploading, a tile row at
+  // a time when they are too large for one tile.
+  void *pixels;
+  bool stb_pixels;
+  hdr_file_t radiance_file;
+  bool streamed;
+
+  // Mapped staging buffer holding the decoded image, if any, which the
+  // upload takes ownership of
+  VkBuffer staging_buffer;
+  VmaAllocation staging_allocation;
+  void *staging_pixels;
+} skybox_source_t;
+
+// Lets the loader thread decode into a staging buffer, which only the main
+// thread can create once the device exists. The loader asks for one, of 0
+// bytes if it doesn't need it, and waits for the main thread to provide it.
+typedef struct staging_handoff_t {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  bool requested;
+  size_t size;
+
+  bool provided;
+  VkBuffer buffer;
+  VmaAllocation allocation;
+  void *pixels;
+} staging_handoff_t;
+
+// Called by the loader exactly once. Returns the mapped buffer, or NULL for
+// a size of 0.
+static void *staging_handoff_request(staging_handoff_t *handoff, size_t size) {
+  pthread_mutex_lock(&handoff->mutex);
+  handoff->requested = true;
+  handoff->size = size;
+  pthread_cond_broadcast(&handoff->cond);
+  while (size > 0 && !handoff->provided) {
+    pthread_cond_wait(&handoff->cond, &handoff->mutex);
+  }
+  pthread_mutex_unlock(&handoff->mutex);
+
+  return handoff->pixels;
+}
+
+// Called by the main thread once the allocator exists. Waits for the loader
+// to know what it needs, which is as soon as it has opened the input.
+static void staging_handoff_provide(staging_handoff_t *handoff) {
+  pthread_mutex_lock(&handoff->mutex);
+  while (!handoff->requested) {
+    pthread_cond_wait(&handoff->cond, &handoff->mutex);
+  }
+
+  if (handoff->size > 0) {
+    create_buffer(
+        &handoff->buffer,
+        &handoff->allocation,
+        handoff->size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VMA_MEMORY_USAGE_CPU_ONLY,
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    vmaMapMemory(g_gpu_allocator, handoff->allocation, &handoff->pixels);
+
+    handoff->provided = true;
+    pthread_cond_broadcast(&handoff->cond);
+  }
+  pthread_mutex_unlock(&handoff->mutex);
+}
+
+// Loads a whole image as RGBA32F, or returns NULL
+static float *load_float_image(
+    const char *path, uint32_t *width, uint32_t *height, bool *stb_pixels) {
+  hdr_file_t radiance_file;
+  if (hdr_file_open(&radiance_file, path)) {
+    *width = radiance_file.width;
+    *height = radiance_file.height;
+    *stb_pixels = false;
+
+    float *pixels =
+        malloc((size_t)radiance_file.width * radiance_file.height * 4 *
+               sizeof(float));
+    if (pixels != NULL &&
+        !hdr_file_decode(&radiance_file, HDR_PIXEL_FORMAT_RGBA32F, pixels)) {
+      free(pixels);
+      pixels = NULL;
+    }
+
+    hdr_file_close(&radiance_file);
+    return pixels;
+  }
+
+  int w, h, nr_components;
+  float *pixels = stbi_loadf(path, &w, &h, &nr_components, 4);
+  *width = (uint32_t)w;
+  *height = (uint32_t)h;
+  *stb_pixels = true;
+  return pixels;
+}
+
+// Tells a cube cross apart from an equirect by its aspect ratio
+static skybox_layout_t
+detect_skybox_layout(uint32_t width, uint32_t height, uint32_t *face_size) {
+  if (width % 4 == 0 && width / 4 * 3 == height) {
+    *face_size = width / 4;
+    return SKYBOX_LAYOUT_HORIZONTAL_CROSS;
+  }
+  if (width % 3 == 0 && width / 3 * 4 == height) {
+    *face_size = width / 3;
+    return SKYBOX_LAYOUT_VERTICAL_CROSS;
+  }
+  return SKYBOX_LAYOUT_EQUIREC;
+}
+
+// Loads the six images of a face set and packs them one after another
+static void skybox_source_load_faces(skybox_source_t *source) {
+  const char *path = source->path;
+  const char *marker = strstr(path, "%s");
+  float *faces = NULL;
+
+  for (uint32_t face = 0; face < 6; face++) {
+    char face_path[4096];
+    snprintf(
+        face_path,
+        sizeof(face_path),
+        "%.*s%s%s",
+        (int)(marker - path),
+        path,
+        CUBE_FACE_NAMES[face],
+        marker + 2);
+
+    uint32_t width, height;
+    bool stb_pixels;
+    float *pixels = load_float_image(face_path, &width, &height, &stb_pixels);
+    if (pixels == NULL) {
+      printf("Failed to load %s\n", face_path);
+      abort();
+    }
+
+    if (face == 0) {
+      source->face_size = width;
+      faces = malloc((size_t)width * width * 4 * sizeof(float) * 6);
+      assert(faces != NULL);
+    }
+
+    if (width != source->face_size || height != source->face_size) {
+      printf("Cube faces must be square and the same size: %s\n", face_path);
+      abort();
+    }
+
+    size_t face_float_count = (size_t)width * height * 4;
+    memcpy(
+        &faces[face_float_count * face],
+        pixels,
+        face_float_count * sizeof(float));
+
+    if (stb_pixels) {
+      stbi_image_free(pixels);
+    } else {
+      free(pixels);
+    }
+  }
+
+  source->pixels = faces;
+  source->width = source->face_size;
+  source->height = source->face_size * 6;
+}
+
+// The -Z face of a vertical cross is upside down, turns it around so all
+// faces can be copied as they are
+static void rotate_vertical_cross_back_face(skybox_source_t *source) {
+  float *pixels = source->pixels;
+  uint32_t face_size = source->face_size;
+  size_t cell = (size_t)VERTICAL_CROSS_CELLS[5][1] * face_size * source->width +
+                (size_t)VERTICAL_CROSS_CELLS[5][0] * face_size;
+
+  size_t count = (size_t)face_size * face_size;
+  for (size_t i = 0; i < count / 2; i++) {
+    size_t j = count - 1 - i;
+    float *a =
+        &pixels[(cell + (i / face_size) * source->width + i % face_size) * 4];
+    float *b =
+        &pixels[(cell + (j / face_size) * source->width + j % face_size) * 4];
+
+    for (uint32_t c = 0; c < 4; c++) {
+      float tmp = a[c];
+      a[c] = b[c];
+      b[c] = tmp;
+    }
+  }
+}
+
+static void skybox_source_set_pixel_format(
+    skybox_source_t *source, hdr_pixel_format_t pixel_format) {
+  source->pixel_format = pixel_format;
+  source->texel_size = hdr_pixel_format_size(pixel_format);
+
+  switch (pixel_format) {
+  case HDR_PIXEL_FORMAT_RGBA32F:
+    source->format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    break;
+  case HDR_PIXEL_FORMAT_RGBE8:
+    source->format = VK_FORMAT_R8G8B8A8_UINT;
+    break;
+  case HDR_PIXEL_FORMAT_RGBA16F:
+    source->format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    break;
+  case HDR_PIXEL_FORMAT_B10G11R11:
+    source->format = VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+    break;
+  default:
+    printf("Invalid pixel format %d\n", pixel_format);
+    abort();
+  }
+}
+
+// Repacks loaded RGBA32F pixels into a smaller format, freeing the floats
+static void skybox_source_pack(
+    skybox_source_t *source, hdr_pixel_format_t pixel_format) {
+  if (pixel_format == HDR_PIXEL_FORMAT_RGBA32F) {
+    return;
+  }
+
+  skybox_source_set_pixel_format(source, pixel_format);
+
+  size_t pixel_count = (size_t)source->width * source->height;
+  void *pixels = malloc(pixel_count * source->texel_size);
+  assert(pixels != NULL);
+  hdr_pack_rgba32f(pixel_format, source->pixels, pixel_count, pixels);
+
+  if (source->stb_pixels) {
+    stbi_image_free(source->pixels);
+  } else {
+    free(source->pixels);
+  }
+  source->pixels = pixels;
+  source->stb_pixels = false;
+}
+
+// Reads and decodes the skybox input into host memory, or into a staging
+// buffer from handoff for Radiance equirects that fit in one tile. Without a
+// handoff, those are only opened and decoded while uploading. Doesn't touch
+// Vulkan, so it runs on its own thread while the device and pipelines are
+// created.
+static void skybox_source_load(
+    skybox_source_t *source,
+    const char *path,
+    uint32_t face_size,
+    const bake_options_t *options,
+    staging_handoff_t *handoff) {
+  *source = (skybox_source_t){};
+  source->path = path;
+  skybox_source_set_pixel_format(source, HDR_PIXEL_FORMAT_RGBA32F);
+
+  // A %s in the path stands for the name of each of six face images
+  if (strstr(path, "%s") != NULL) {
+    source->layout = SKYBOX_LAYOUT_FACES;
+    skybox_source_load_faces(source);
+    return;
+  }
+
+  // Radiance files go through our own decoder. Anything else is loaded by
+  // stb.
+  hdr_file_t *radiance_file = &source->radiance_file;
+  if (!hdr_file_open(radiance_file, path)) {
+    int width, height, nr_components;
+
+    // LDR equirects are uploaded as they are, 8 bits per channel, and the
+    // sampler converts them from sRGB to linear. Cube inputs are copied
+    // into the float skybox, so they still need floats.
+    if (!stbi_is_hdr(path) &&
+        stbi_info(path, &width, &height, &nr_components) &&
+        detect_skybox_layout(
+            (uint32_t)width, (uint32_t)height, &source->face_size) ==
+            SKYBOX_LAYOUT_EQUIREC) {
+      source->pixels = stbi_load(path, &width, &height, &nr_components, 4);
+      if (source->pixels == NULL) {
+        printf("Failed to load %s\n", path);
+        abort();
+      }
+
+      source->width = (uint32_t)width;
+      source->height = (uint32_t)height;
+      source->stb_pixels = true;
+      source->format = VK_FORMAT_R8G8B8A8_SRGB;
+      source->texel_size = 4;
+      return;
+    }
+
+    source->pixels = stbi_loadf(path, &width, &height, &nr_components, 4);
+    if (source->pixels == NULL) {
+      printf("Failed to load %s\n", path);
+      abort();
+    }
+
+    source->width = (uint32_t)width;
+    source->height = (uint32_t)height;
+    source->stb_pixels = true;
+    source->layout = detect_skybox_layout(
+        source->width, source->height, &source->face_size);
+    if (source->layout == SKYBOX_LAYOUT_VERTICAL_CROSS) {
+      rotate_vertical_cross_back_face(source);
+    }
+    if (source->layout == SKYBOX_LAYOUT_EQUIREC) {
+      skybox_source_pack(source, options->source_format);
+    }
+    return;
+  }
+
+  source->width = radiance_file->width;
+  source->height = radiance_file->height;
+
+  source->layout = detect_skybox_layout(
+      source->width, source->height, &source->face_size);
+  if (source->layout != SKYBOX_LAYOUT_EQUIREC) {
+    source->pixels =
+        malloc((size_t)source->width * source->height * 4 * sizeof(float));
+    assert(source->pixels != NULL);
+
+    if (!hdr_file_decode(
+            radiance_file, HDR_PIXEL_FORMAT_RGBA32F, source->pixels)) {
+      printf("Failed to decode %s\n", path);
+      abort();
+    }
+
+    hdr_file_close(radiance_file);
+    if (source->layout == SKYBOX_LAYOUT_VERTICAL_CROSS) {
+      rotate_vertical_cross_back_face(source);
+    }
+    return;
+  }
+
+  // A face only needs 4 face widths of texels around the equator and 2 from
+  // pole to pole. Larger panoramas can be filtered down to that while they
+  // are decoded, keeping only a few full size rows in memory.
+  uint32_t target_width = 4 * face_size;
+  uint32_t target_height = 2 * face_size;
+  bool downsample = options->downsample && (source->width > target_width ||
+                                            source->height > target_height);
+
+  if (downsample) {
+    if (source->width > target_width) {
+      source->width = target_width;
+    }
+    if (source->height > target_height) {
+      source->height = target_height;
+    }
+
+    skybox_source_set_pixel_format(source, options->source_format);
+    source->pixels = malloc(
+        (size_t)source->width * source->height * source->texel_size);
+    assert(source->pixels != NULL);
+
+    if (!hdr_file_decode_resampled(
+            radiance_file,
+            options->downsample_filter,
+            source->pixel_format,
+            source->width,
+            source->height,
+            source->pixels)) {
+      printf("Failed to decode %s\n", path);
+      abort();
+    }
+
+    hdr_file_close(radiance_file);
+    return;
+  }
+
+  // Otherwise Radiance files are uploaded as raw RGBE bytes (a quarter of
+  // the RGBA32F size) and expanded to floats in the fragment shader, which
+  // filters them by hand since integer textures can't be linearly filtered
+  if (options->cpu_decode) {
+    skybox_source_set_pixel_format(source, options->source_format);
+  } else {
+    skybox_source_set_pixel_format(source, HDR_PIXEL_FORMAT_RGBE8);
+  }
+
+  source->streamed = true;
+
+  if (handoff == NULL || source->width > EQUIREC_TILE_SIZE_MAX ||
+      source->height > EQUIREC_TILE_SIZE_MAX) {
+    return;
+  }
+
+  source->staging_pixels = staging_handoff_request(
+      handoff, (size_t)source->width * source->height * source->texel_size);
+  source->staging_buffer = handoff->buffer;
+  source->staging_allocation = handoff->allocation;
+
+  if (!hdr_file_decode(
+          radiance_file, source->pixel_format, source->staging_pixels)) {
+    printf("Failed to decode %s\n", path);
+    abort();
+  }
+
+  hdr_file_close(radiance_file);
+  source->streamed = false;
+}
+
+typedef struct skybox_load_job_t {
+  skybox_source_t *source;
+  const char *path;
+  uint32_t face_size;
+  const bake_options_t *options;
+  staging_handoff_t *handoff;
+} skybox_load_job_t;
+
+static void *skybox_source_load_worker(void *arg) {
+  skybox_load_job_t *job = arg;
+  skybox_source_load(
+      job->source, job->path, job->face_size, job->options, job->handoff);
+
+  // Let the main thread go on if the input didn't need a staging buffer
+  if (job->handoff != NULL && !job->handoff->requested) {
+    staging_handoff_request(job->handoff, 0);
+  }
+  return NULL;
+}
+
+static void skybox_source_destroy(skybox_source_t *source) {
+  if (source->streamed) {
+    hdr_file_close(&source->radiance_file);
+  } else if (source->stb_pixels) {
+    stbi_image_free(source->pixels);
+  } else {
+    free(source->pixels);
+  }
+}
+
+// Copies the texels of one tile, border included, from a band of full
+// panorama rows into the staging buffer. Columns wrap around since the
+// panorama is periodic in longitude, rows past the poles repeat the edge row.
+static void copy_equirec_tile_texels(
+    unsigned char *dst,
+    uint32_t dst_row_length,
+    const unsigned char *band,
+    uint32_t band_first_row,
+    uint32_t width,
+    uint32_t height,
+    size_t pixel_size,
+    int64_t upload_x,
+    int64_t upload_y,
+    uint32_t upload_width,
+    uint32_t upload_height) {
+  for (uint32_t row = 0; row < upload_height; row++) {
+    int64_t y = upload_y + row;
+    if (y < 0) {
+      y = 0;
+    }
+    if (y > (int64_t)height - 1) {
+      y = (int64_t)height - 1;
+    }
+
+    const unsigned char *src_row =
+        &band[(size_t)(y - band_first_row) * width * pixel_size];
+    unsigned char *dst_row = &dst[(size_t)row * dst_row_length * pixel_size];
+
+    uint32_t col = 0;
+    while (col < upload_width) {
+      uint32_t x = (uint32_t)(((upload_x + col) % width + width) % width);
+      uint32_t run = width - x;
+      if (run > upload_width - col) {
+        run = upload_width - col;
+      }
+
+      memcpy(
+          &dst_row[col * pixel_size],
+          &src_row[x * pixel_size],
+          run * pixel_size);
+      col += run;
+    }
+  }
+}
+
+static void render_equirec_to_cubemap(
+    skybox_source_t *source, cubemap_t *dest_cubemap, uint32_t level) {
+  bool gpu_decode = source->format == VK_FORMAT_R8G8B8A8_UINT;
+  VkFormat hdr_format = source->format;
+  VkPipeline pipeline = g_bake_pipelines
+      [gpu_decode ? BAKE_PIPELINE_SKYBOX_RGBE : BAKE_PIPELINE_SKYBOX];
+
+  uint32_t hdr_width = source->width;
+  uint32_t hdr_height = source->height;
+  size_t pixel_size = source->texel_size;
+
+  // Split the panorama into a grid of evenly sized tiles. When there is more
+  // than one, each tile also gets a one texel border from its neighbours so
+  // that filtering is seamless across tiles.
+  bool tiled =
+      hdr_width > EQUIREC_TILE_SIZE_MAX || hdr_height > EQUIREC_TILE_SIZE_MAX;
+  uint32_t tile_border = tiled ? 1 : 0;
+
+  uint32_t tile_size_inner = EQUIREC_TILE_SIZE_MAX - 2 * tile_border;
+  uint32_t tiles_x = (hdr_width + tile_size_inner - 1) / tile_size_inner;
+  uint32_t tiles_y = (hdr_height + tile_size_inner - 1) / tile_size_inner;
+  uint32_t tile_width = (hdr_width + tiles_x - 1) / tiles_x;
+  uint32_t tile_height = (hdr_height + tiles_y - 1) / tiles_y;
+
+  uint32_t tile_image_width = tile_width + 2 * tile_border;
+  uint32_t tile_image_height = tile_height + 2 * tile_border;
+
+  // Create HDR VkImage and stuff. It holds one tile at a time.
+  VkImage hdr_image = VK_NULL_HANDLE;
+  VmaAllocation hdr_allocation = VK_NULL_HANDLE;
+  VkImageView hdr_image_view = VK_NULL_HANDLE;
+  VkSampler hdr_sampler = VK_NULL_HANDLE;
+
+  create_image_and_image_view(
+      &hdr_image,
+      &hdr_allocation,
+      &hdr_image_view,
+      hdr_format,
+      tile_image_width,
+      tile_image_height,
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+  create_sampler(
+      &hdr_sampler, gpu_decode ? VK_FILTER_NEAREST : VK_FILTER_LINEAR);
+
+  VkBuffer staging_buffer;
+  VmaAllocation staging_allocation;
+  void *stagingMemoryPointer;
+
+  // The loader thread may have decoded the image into a staging buffer
+  // already, which we take over
+  bool staged = source->staging_buffer != VK_NULL_HANDLE;
+  if (staged) {
+    staging_buffer = source->staging_buffer;
+    staging_allocation = source->staging_allocation;
+    stagingMemoryPointer = source->staging_pixels;
+    source->staging_buffer = VK_NULL_HANDLE;
+  } else {
+    create_buffer(
+        &staging_buffer,
+        &staging_allocation,
+        (size_t)tile_image_width * tile_image_height * pixel_size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VMA_MEMORY_USAGE_CPU_ONLY,
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    vmaMapMemory(g_gpu_allocator, staging_allocation, &stagingMemoryPointer);
+  }
+
+  // Full width rows of the tile row being rendered, plus borders. Only
+  // needed when decoding a streamed Radiance file in tiles, otherwise we
+  // have the whole image or decode it straight into the staging buffer.
+  unsigned char *band = NULL;
+  if (source->streamed && tiled) {
+    band = malloc((size_t)tile_image_height * hdr_width * pixel_size);
+    assert(band != NULL);
+  }
+
+  bool compute = g_bake_backend == BAKE_BACKEND_COMPUTE;
+
+  push_constant_t pc = {};
+
+  // Every tile adds the texels it covers to the faces. With render passes the
+  // first one clears them and the others load what is already there. Compute
+  // dispatches write each texel from the one tile covering it, so the level
+  // only needs to be in the general layout.
+  VkRenderPass clear_render_pass = VK_NULL_HANDLE;
+  VkRenderPass load_render_pass = VK_NULL_HANDLE;
+  if (!compute) {
+    create_render_pass(
+        dest_cubemap->format, VK_ATTACHMENT_LOAD_OP_CLEAR, &clear_render_pass);
+    create_render_pass(
+        dest_cubemap->format, VK_ATTACHMENT_LOAD_OP_LOAD, &load_render_pass);
+  }
+
+  cube_target_t target;
+  cube_target_init(&target, dest_cubemap, level, clear_render_pass);
+
+  VkDescriptorSet descriptor_set = allocate_bake_descriptor_set(
+      hdr_sampler, hdr_image_view, target.image_view, VK_NULL_HANDLE);
+
+  VkImageSubresourceRange subresource_range = {};
+  subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresource_range.baseMipLevel = 0;
+  subresource_range.levelCount = 1;
+  subresource_range.baseArrayLayer = 0;
+  subresource_range.layerCount = 1;
+
+  VkImageSubresourceRange dest_subresource_range = {};
+  dest_subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  dest_subresource_range.baseMipLevel = level;
+  dest_subresource_range.levelCount = 1;
+  dest_subresource_range.baseArrayLayer = 0;
+  dest_subresource_range.layerCount = CUBE_FACE_COUNT;
+
+  if (compute) {
+    VkCommandBuffer command_buffer = begin_single_time_command_buffer();
+
+    set_image_layout(
+        command_buffer,
+        dest_cubemap->image,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_GENERAL,
+        dest_subresource_range,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    end_single_time_command_buffer(command_buffer);
+  }
+
+  for (uint32_t tile_y = 0; tile_y < tiles_y; tile_y++) {
+    uint32_t y0 = tile_y * tile_height;
+    uint32_t y1 = y0 + tile_height;
+    if (y1 > hdr_height) {
+      y1 = hdr_height;
+    }
+
+    // Rows of this tile row, border included, clamped to the panorama
+    uint32_t band_first_row = y0 > tile_border ? y0 - tile_border : 0;
+    uint32_t band_end_row = y1 + tile_border;
+    if (band_end_row > hdr_height) {
+      band_end_row = hdr_height;
+    }
+
+    const unsigned char *band_rows = NULL;
+    if (source->streamed && tiled) {
+      if (!hdr_file_decode_rows(
+              &source->radiance_file,
+              source->pixel_format,
+              band_first_row,
+              band_end_row - band_first_row,
+              band)) {
+        printf("Failed to decode %s\n", source->path);
+        abort();
+      }
+      band_rows = band;
+    } else if (source->pixels != NULL) {
+      band_rows = (const unsigned char *)source->pixels +
+                  (size_t)band_first_row * hdr_width * pixel_size;
+    }
+
+    for (uint32_t tile_x = 0; tile_x < tiles_x; tile_x++) {
+      uint32_t x0 = tile_x * tile_width;
+      uint32_t x1 = x0 + tile_width;
+      if (x1 > hdr_width) {
+        x1 = hdr_width;
+      }
+
+      uint32_t upload_width = x1 - x0 + 2 * tile_border;
+      uint32_t upload_height = y1 - y0 + 2 * tile_border;
+
+      if (staged) {
+        // The whole panorama is one tile, already in the staging buffer
+      } else if (!tiled && source->streamed) {
+        // The whole panorama is one tile, decoded without a copy
+        if (!hdr_file_decode(
+                &source->radiance_file,
+                source->pixel_format,
+                stagingMemoryPointer)) {
+          printf("Failed to decode %s\n", source->path);
+          abort();
+        }
+      } else if (!tiled) {
+        // The whole panorama is one tile
+        memcpy(
+            stagingMemoryPointer,
+            source->pixels,
+            (size_t)hdr_width * hdr_height * pixel_size);
+      } else {
+        copy_equirec_tile_texels(
+            stagingMemoryPointer,
+            tile_image_width,
+            band_rows,
+            band_first_row,
+            hdr_width,
+            hdr_height,
+            pixel_size,
+            (int64_t)x0 - tile_border,
+            (int64_t)y0 - tile_border,
+            upload_width,
+            upload_height);
+      }
+
+      VkCommandBuffer command_buffer = begin_single_time_command_buffer();
+
+      // Upload the tile
+      set_image_layout(
+          command_buffer,
+          hdr_image,
+          VK_IMAGE_LAYOUT_UNDEFINED,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          subresource_range,
+          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+      VkBufferImageCopy region = (VkBufferImageCopy){
+          0,                // bufferOffset
+          tile_image_width, // bufferRowLength
+          0,                // bufferImageHeight
+          {
+              VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+              0,                         // mipLevel
+              0,                         // baseArrayLayer
+              1,                         // layerCount
+          },                                // imageSubresource
+          {0, 0, 0},                        // imageOffset
+          {upload_width, upload_height, 1}, // imageExtent
+      };
+
+      vkCmdCopyBufferToImage(
+          command_buffer,
+          staging_buffer,
+          hdr_image,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          1,
+          &region);
+
+      set_image_layout(
+          command_buffer,
+          hdr_image,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+          subresource_range,
+          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+      // The part of the panorama this tile renders, in the shader's uv space.
+      // Tiles on the edges extend past it so no fragment is left out.
+      pc.tile_rect[0] = tile_x == 0 ? -1.0f : (float)x0 / hdr_width;
+      pc.tile_rect[1] = tile_y == 0 ? -1.0f : (float)y0 / hdr_height;
+      pc.tile_rect[2] = tile_x == tiles_x - 1 ? 2.0f : (float)x1 / hdr_width;
+      pc.tile_rect[3] = tile_y == tiles_y - 1 ? 2.0f : (float)y1 / hdr_height;
+
+      // Panorama uv to tile image uv
+      pc.tile_transform[0] = (float)hdr_width / tile_image_width;
+      pc.tile_transform[1] = (float)hdr_height / tile_image_height;
+      pc.tile_transform[2] =
+          -((float)x0 - (float)tile_border) / tile_image_width;
+      pc.tile_transform[3] =
+          -((float)y0 - (float)tile_border) / tile_image_height;
+
+      vkCmdBindPipeline(command_buffer, g_bake_pipeline_bind_point, pipeline);
+
+      vkCmdBindDescriptorSets(
+          command_buffer,
+          g_bake_pipeline_bind_point,
+          g_bake_pipeline_layout,
+          0, // firstSet
+          1,
+          &descriptor_set,
+          0,
+          NULL);
+
+      vkCmdPushConstants(
+          command_buffer,
+          g_bake_pipeline_layout,
+          g_bake_push_constant_stages,
+          0,
+          sizeof(push_constant_t),
+          &pc);
+
+      if (compute) {
+        dispatch_bake_level(command_buffer, target.width, target.height);
+      } else {
+        VkRenderPass render_pass =
+            tile_x == 0 && tile_y == 0 ? clear_render_pass : load_render_pass;
+
+        cube_target_begin(&target, render_pass, command_buffer);
+        vkCmdDraw(command_buffer, 3, 1, 0, 0);
+        cube_target_end(command_buffer);
+      }
+
+      // Waits for the GPU, so the tile image and staging buffer can be
+      // reused by the next tile
+      end_single_time_command_buffer(command_buffer);
+    }
+  }
+
+  free(band);
+
+  if (compute) {
+    VkCommandBuffer command_buffer = begin_single_time_command_buffer();
+
+    set_image_layout(
+        command_buffer,
+        dest_cubemap->image,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        dest_subresource_range,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    end_single_time_command_buffer(command_buffer);
+  }
+
+  vmaUnmapMemory(g_gpu_allocator, staging_allocation);
+  vmaDestroyBuffer(g_gpu_allocator, staging_buffer, staging_allocation);
+
+  VK_CHECK(vkDeviceWaitIdle(g_device));
+
+  vkDestroyImageView(g_device, hdr_image_view, NULL);
+  vkDestroySampler(g_device, hdr_sampler, NULL);
+  vmaDestroyImage(g_gpu_allocator, hdr_image, hdr_allocation);
+
+  vkFreeDescriptorSets(g_device, g_descriptor_pool, 1, &descriptor_set);
+
+  cube_target_destroy(&target);
+
+  if (!compute) {
+    vkDestroyRenderPass(g_device, clear_render_pass, NULL);
+    vkDestroyRenderPass(g_device, load_render_pass, NULL);
+  }
+}
+
+// Bakes level_count levels of dest_cubemap starting at first_level from
+// source_cubemap. Other levels are left alone. level_constants holds the push
+// constants of each level of dest_cubemap. samples is the sample table the
+// pipeline reads, or VK_NULL_HANDLE.
+static void render_cubemap_to_cubemap(
+    cubemap_t *dest_cubemap,
+    uint32_t first_level,
+    uint32_t level_count,
+    cubemap_t *source_cubemap,
+    const push_constant_t *level_constants,
+    VkBuffer samples,
+    VkPipeline pipeline) {
+  bool compute = g_bake_backend == BAKE_BACKEND_COMPUTE;
+
+  // Targets are already sized per level, and the fullscreen triangle writes
+  // every texel of them, so there is nothing to clear either
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  if (!compute) {
+    create_render_pass(
+        dest_cubemap->format, VK_ATTACHMENT_LOAD_OP_DONT_CARE, &render_pass);
+  }
+
+  // A target for every baked level. Compute writes each level through its
+  // own storage view, so it also needs a descriptor set per level.
+  uint32_t set_count = compute ? level_count : 1;
+  cube_target_t *targets = malloc(level_count * sizeof(cube_target_t));
+  VkDescriptorSet *descriptor_sets =
+      malloc(set_count * sizeof(VkDescriptorSet));
+  assert(targets != NULL && descriptor_sets != NULL);
+  for (uint32_t i = 0; i < level_count; i++) {
+    cube_target_init(&targets[i], dest_cubemap, first_level + i, render_pass);
+  }
+  for (uint32_t i = 0; i < set_count; i++) {
+    descriptor_sets[i] = allocate_bake_descriptor_set(
+        source_cubemap->sampler,
+        source_cubemap->image_view,
+        targets[i].image_view,
+        samples);
+  }
+
+  // Allocate command buffer
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
   {
     VkCommandBufferAllocateInfo allocate_info = {};
     allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1646,37 +2611,65 @@ static void render_equirec_to_cubemap(
 
   VK_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info));
 
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-  vkCmdBindDescriptorSets(
-      command_buffer,
-      VK_PIPELINE_BIND_POINT_GRAPHICS,
-      pipeline_layout,
-      0, // firstSet
-      1,
-      &descriptor_set,
-      0,
-      NULL);
+  VkImageSubresourceRange subresource_range = {};
+  subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresource_range.baseMipLevel = first_level;
+  subresource_range.levelCount = level_count;
+  subresource_range.baseArrayLayer = 0;
+  subresource_range.layerCount = CUBE_FACE_COUNT;
 
-  for (size_t i = 0; i < ARRAYSIZE(camera_views); i++) {
-    canvas_begin(&canvas, command_buffer);
+  if (compute) {
+    set_image_layout(
+        command_buffer,
+        dest_cubemap->image,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_GENERAL,
+        subresource_range,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+  }
 
-    pc.mvp = mat4_mul(camera_views[i], proj);
+  vkCmdBindPipeline(command_buffer, g_bake_pipeline_bind_point, pipeline);
+
+  for (uint32_t i = 0; i < level_count; i++) {
+    if (i < set_count) {
+      vkCmdBindDescriptorSets(
+          command_buffer,
+          g_bake_pipeline_bind_point,
+          g_bake_pipeline_layout,
+          0, // firstSet
+          1,
+          &descriptor_sets[i],
+          0,
+          NULL);
+    }
 
     vkCmdPushConstants(
         command_buffer,
-        pipeline_layout,
-        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        g_bake_pipeline_layout,
+        g_bake_push_constant_stages,
         0,
         sizeof(push_constant_t),
-        &pc);
-
-    vkCmdDraw(command_buffer, 36, 1, 0, 0);
-
-    canvas_end(&canvas, command_buffer);
+        &level_constants[first_level + i]);
+
+    if (compute) {
+      dispatch_bake_level(command_buffer, targets[i].width, targets[i].height);
+    } else {
+      cube_target_begin(&targets[i], render_pass, command_buffer);
+      vkCmdDraw(command_buffer, 3, 1, 0, 0);
+      cube_target_end(command_buffer);
+    }
+  }
 
-    copy_side_image_to_cubemap(
-        command_buffer, canvas.image, dest_cubemap, i, level);
+  if (compute) {
+    set_image_layout(
+        command_buffer,
+        dest_cubemap->image,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        subresource_range,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
   }
 
   VK_CHECK(vkEndCommandBuffer(command_buffer));
@@ -1701,169 +2694,526 @@ static void render_equirec_to_cubemap(
 
   VK_CHECK(vkDeviceWaitIdle(g_device));
 
-  vkDestroyImageView(g_device, hdr_image_view, NULL);
-  vkDestroySampler(g_device, hdr_sampler, NULL);
-  vmaDestroyImage(g_gpu_allocator, hdr_image, hdr_allocation);
-
   vkFreeCommandBuffers(g_device, g_command_pool, 1, &command_buffer);
 
-  vkFreeDescriptorSets(g_device, g_descriptor_pool, 1, &descriptor_set);
+  vkFreeDescriptorSets(
+      g_device, g_descriptor_pool, set_count, descriptor_sets);
+  free(descriptor_sets);
+
+  for (uint32_t i = 0; i < level_count; i++) {
+    cube_target_destroy(&targets[i]);
+  }
+  free(targets);
+
+  if (!compute) {
+    vkDestroyRenderPass(g_device, render_pass, NULL);
+  }
+}
+
+static void create_cubemap_image(
+    VkImage *image,
+    VmaAllocation *allocation,
+    VkImageView *image_view,
+    VkSampler *sampler,
+    VkFormat format,
+    uint32_t width,
+    uint32_t height,
+    uint32_t levels) {
+  VkImageCreateInfo image_create_info = (VkImageCreateInfo){
+      VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      NULL,                                // pNext
+      VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT, // flags
+      VK_IMAGE_TYPE_2D,                    // imageType
+      format,                              // format
+      {
+          width,               // width
+          height,              // height
+          1,                   // depth
+      },                       // extent
+      levels,                  // mipLevels
+      6,                       // arrayLayers
+      VK_SAMPLE_COUNT_1_BIT,   // samples
+      VK_IMAGE_TILING_OPTIMAL, // tiling
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+          VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+          VK_IMAGE_USAGE_STORAGE_BIT,  // usage
+      VK_SHARING_MODE_EXCLUSIVE,       // sharingMode
+      1,                               // queueFamilyIndexCount
+      &g_graphics_queue_family_index,  // pQueueFamilyIndices
+      VK_IMAGE_LAYOUT_UNDEFINED,       // initialLayout
+  };
+
+  VmaAllocationCreateInfo image_alloc_create_info = {};
+  image_alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  VK_CHECK(vmaCreateImage(
+      g_gpu_allocator,
+      &image_create_info,
+      &image_alloc_create_info,
+      image,
+      allocation,
+      NULL));
+
+  VkImageViewCreateInfo image_view_create_info = (VkImageViewCreateInfo){
+      VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      NULL,
+      0,                       // flags
+      *image,                  // image
+      VK_IMAGE_VIEW_TYPE_CUBE, // viewType
+      format,                  // format
+      {
+          VK_COMPONENT_SWIZZLE_IDENTITY, // r
+          VK_COMPONENT_SWIZZLE_IDENTITY, // g
+          VK_COMPONENT_SWIZZLE_IDENTITY, // b
+          VK_COMPONENT_SWIZZLE_IDENTITY, // a
+      },                                 // components
+      {
+          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+          0,                         // baseMipLevel
+          levels,                    // levelCount
+          0,                         // baseArrayLayer
+          6,                         // layerCount
+      },                             // subresourceRange
+  };
+
+  VK_CHECK(
+      vkCreateImageView(g_device, &image_view_create_info, NULL, image_view));
+
+  VkSamplerCreateInfo sampler_create_info = (VkSamplerCreateInfo){
+      VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+      NULL,
+      0,                                       // flags
+      VK_FILTER_LINEAR,                        // magFilter
+      VK_FILTER_LINEAR,                        // minFilter
+      VK_SAMPLER_MIPMAP_MODE_LINEAR,           // mipmapMode
+      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeU
+      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeV
+      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeW
+      0.0f,                                    // mipLodBias
+      VK_FALSE,                                // anisotropyEnable
+      1.0f,                                    // maxAnisotropy
+      VK_FALSE,                                // compareEnable
+      VK_COMPARE_OP_NEVER,                     // compareOp
+      0.0f,                                    // minLod
+      (float)levels,                           // maxLod
+      VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK, // borderColor
+      VK_FALSE,                                // unnormalizedCoordinates
+  };
+
+  VK_CHECK(vkCreateSampler(g_device, &sampler_create_info, NULL, sampler));
+}
+
+// Creates a cube view of a single level of a cubemap, for sampling it while
+// other levels are being rendered
+static void create_cubemap_level_view(
+    cubemap_t *cubemap,
+    uint32_t level,
+    VkImageView *image_view) {
+  VkImageViewCreateInfo image_view_create_info = (VkImageViewCreateInfo){
+      VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      NULL,
+      0,                       // flags
+      cubemap->image,          // image
+      VK_IMAGE_VIEW_TYPE_CUBE, // viewType
+      cubemap->format,         // format
+      {
+          VK_COMPONENT_SWIZZLE_IDENTITY, // r
+          VK_COMPONENT_SWIZZLE_IDENTITY, // g
+          VK_COMPONENT_SWIZZLE_IDENTITY, // b
+          VK_COMPONENT_SWIZZLE_IDENTITY, // a
+      },                                 // components
+      {
+          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+          level,                     // baseMipLevel
+          1,                         // levelCount
+          0,                         // baseArrayLayer
+          CUBE_FACE_COUNT,           // layerCount
+      },                             // subresourceRange
+  };
+
+  VK_CHECK(
+      vkCreateImageView(g_device, &image_view_create_info, NULL, image_view));
+}
+
+// Fills a level of a cubemap from six tightly packed RGBA32F faces, leaving
+// it in SHADER_READ_ONLY_OPTIMAL like the bake stages do
+static void
+upload_cubemap_level(cubemap_t *cubemap, uint32_t level, const float *pixels) {
+  uint32_t width = cubemap->width >> level;
+  uint32_t height = cubemap->height >> level;
+  size_t pixels_size =
+      (size_t)width * height * CUBE_FACE_COUNT * 4 * sizeof(float);
+
+  VkBuffer staging_buffer;
+  VmaAllocation staging_allocation;
+
+  create_buffer(
+      &staging_buffer,
+      &staging_allocation,
+      pixels_size,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VMA_MEMORY_USAGE_CPU_ONLY,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  void *staging_memory_pointer;
+  vmaMapMemory(g_gpu_allocator, staging_allocation, &staging_memory_pointer);
+  memcpy(staging_memory_pointer, pixels, pixels_size);
+  vmaUnmapMemory(g_gpu_allocator, staging_allocation);
+
+  VkCommandBuffer command_buffer = begin_single_time_command_buffer();
+
+  VkImageSubresourceRange subresource_range = {};
+  subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresource_range.baseMipLevel = level;
+  subresource_range.levelCount = 1;
+  subresource_range.baseArrayLayer = 0;
+  subresource_range.layerCount = CUBE_FACE_COUNT;
+
+  set_image_layout(
+      command_buffer,
+      cubemap->image,
+      VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      subresource_range,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+  VkBufferImageCopy region = (VkBufferImageCopy){
+      0, // bufferOffset
+      0, // bufferRowLength
+      0, // bufferImageHeight
+      {
+          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+          level,                     // mipLevel
+          0,                         // baseArrayLayer
+          CUBE_FACE_COUNT,           // layerCount
+      },                             // imageSubresource
+      {0, 0, 0},                     // imageOffset
+      {width, height, 1},            // imageExtent
+  };
+
+  vkCmdCopyBufferToImage(
+      command_buffer,
+      staging_buffer,
+      cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      1,
+      &region);
+
+  set_image_layout(
+      command_buffer,
+      cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      subresource_range,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+  end_single_time_command_buffer(command_buffer);
+
+  vmaDestroyBuffer(g_gpu_allocator, staging_buffer, staging_allocation);
+}
+
+// Copies layer_count faces of a cubemap level, starting at first_layer, into
+// pixels as tightly packed RGBA32F faces
+static void download_cubemap_faces(
+    cubemap_t *cubemap,
+    uint32_t level,
+    uint32_t first_layer,
+    uint32_t layer_count,
+    float *pixels) {
+  uint32_t width = cubemap->width >> level;
+  uint32_t height = cubemap->height >> level;
+  size_t pixels_size = (size_t)width * height * layer_count * 4 * sizeof(float);
+
+  VkBuffer staging_buffer;
+  VmaAllocation staging_allocation;
+
+  create_buffer(
+      &staging_buffer,
+      &staging_allocation,
+      pixels_size,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_MEMORY_USAGE_CPU_ONLY,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  VkCommandBuffer command_buffer = begin_single_time_command_buffer();
+
+  VkImageSubresourceRange subresource_range = {};
+  subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresource_range.baseMipLevel = level;
+  subresource_range.levelCount = 1;
+  subresource_range.baseArrayLayer = first_layer;
+  subresource_range.layerCount = layer_count;
+
+  // Every face is left in SHADER_READ_ONLY_OPTIMAL once it is rendered
+  set_image_layout(
+      command_buffer,
+      cubemap->image,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      subresource_range,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+  VkBufferImageCopy region = (VkBufferImageCopy){
+      0, // bufferOffset
+      0, // bufferRowLength
+      0, // bufferImageHeight
+      {
+          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+          level,                     // mipLevel
+          first_layer,               // baseArrayLayer
+          layer_count,               // layerCount
+      },                             // imageSubresource
+      {0, 0, 0},                     // imageOffset
+      {width, height, 1},            // imageExtent
+  };
 
-  stbi_image_free(hdr_data);
+  vkCmdCopyImageToBuffer(
+      command_buffer,
+      cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      staging_buffer,
+      1,
+      &region);
 
-  canvas_destroy(&canvas);
+  set_image_layout(
+      command_buffer,
+      cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      subresource_range,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-  vkDestroyShaderModule(g_device, vertex_module, NULL);
+  // Waits for the copy
+  end_single_time_command_buffer(command_buffer);
 
-  vkDestroyShaderModule(g_device, fragment_module, NULL);
+  void *staging_memory_pointer;
+  vmaMapMemory(g_gpu_allocator, staging_allocation, &staging_memory_pointer);
+  memcpy(pixels, staging_memory_pointer, pixels_size);
+  vmaUnmapMemory(g_gpu_allocator, staging_allocation);
 
-  vkDestroyPipeline(g_device, pipeline, NULL);
-  vkDestroyPipelineLayout(g_device, pipeline_layout, NULL);
+  vmaDestroyBuffer(g_gpu_allocator, staging_buffer, staging_allocation);
 }
 
-static void render_cubemap_to_cubemap(
-    cubemap_t *dest_cubemap,
-    cubemap_t *source_cubemap,
-    const char *vert_path,
-    const char *frag_path) {
-  // Create hdrDescriptorSet
-  VkDescriptorSet descriptor_set;
-  {
-    VkDescriptorSetAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.pNext = NULL;
-    alloc_info.descriptorPool = g_descriptor_pool;
-    alloc_info.descriptorSetCount = 1;
-    alloc_info.pSetLayouts = &g_bake_cubemap_descriptor_set_layout;
+// Number of levels in a full mip chain down to 1x1 faces
+static uint32_t cubemap_full_mip_count(uint32_t size) {
+  return (uint32_t)floor(log2(size)) + 1;
+}
 
-    VK_CHECK(vkAllocateDescriptorSets(g_device, &alloc_info, &descriptor_set));
+// First level of a cubemap whose faces are at most size texels wide, or the
+// last level if none is that small
+static uint32_t
+cubemap_level_for_size(const cubemap_t *cubemap, uint32_t size) {
+  uint32_t level = 0;
+  while (level + 1 < cubemap->mip_levels && (cubemap->width >> level) > size) {
+    level++;
   }
+  return level;
+}
 
-  {
-    VkDescriptorImageInfo image_descriptor = {
-        source_cubemap->sampler,
-        source_cubemap->image_view,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-    };
-
-    VkWriteDescriptorSet descriptor_write = {
-        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        NULL,
-        descriptor_set,                            // dstSet
-        0,                                         // dstBinding
-        0,                                         // dstArrayElement
-        1,                                         // descriptorCount
-        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // descriptorType
-        &image_descriptor,                         // pImageInfo
-        NULL,                                      // pBufferInfo
-        NULL,                                      // pTexelBufferView
-    };
+// Records a linear blit of all faces of a source level into a destination
+// level, scaling to fit. The source must be in SHADER_READ_ONLY_OPTIMAL and
+// its contents are kept, the destination's are discarded. Both are left in
+// SHADER_READ_ONLY_OPTIMAL.
+static void cmd_blit_cubemap_level(
+    VkCommandBuffer command_buffer,
+    cubemap_t *src_cubemap,
+    uint32_t src_level,
+    cubemap_t *dst_cubemap,
+    uint32_t dst_level) {
+  int32_t src_width = (int32_t)(src_cubemap->width >> src_level);
+  int32_t src_height = (int32_t)(src_cubemap->height >> src_level);
+  int32_t dst_width = (int32_t)(dst_cubemap->width >> dst_level);
+  int32_t dst_height = (int32_t)(dst_cubemap->height >> dst_level);
+
+  VkImageSubresourceRange src_range = {};
+  src_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  src_range.baseMipLevel = src_level;
+  src_range.levelCount = 1;
+  src_range.baseArrayLayer = 0;
+  src_range.layerCount = CUBE_FACE_COUNT;
+
+  VkImageSubresourceRange dst_range = src_range;
+  dst_range.baseMipLevel = dst_level;
 
-    vkUpdateDescriptorSets(g_device, 1, &descriptor_write, 0, NULL);
-  }
+  set_image_layout(
+      command_buffer,
+      src_cubemap->image,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      src_range,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-  // Camera matrices
-  push_constant_t pc;
-  mat4_t proj = mat4_perspective(to_radians(90.0f), 1.0f, 0.1f, 10.0f);
+  set_image_layout(
+      command_buffer,
+      dst_cubemap->image,
+      VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      dst_range,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-  canvas_t canvas;
-  canvas_init(
-      &canvas, dest_cubemap->width, dest_cubemap->height, dest_cubemap->format);
+  VkImageBlit blit = {
+      {
+          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+          src_level,                 // mipLevel
+          0,                         // baseArrayLayer
+          CUBE_FACE_COUNT,           // layerCount
+      },                             // srcSubresource
+      {{0, 0, 0}, {src_width, src_height, 1}}, // srcOffsets
+      {
+          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+          dst_level,                 // mipLevel
+          0,                         // baseArrayLayer
+          CUBE_FACE_COUNT,           // layerCount
+      },                             // dstSubresource
+      {{0, 0, 0}, {dst_width, dst_height, 1}}, // dstOffsets
+  };
 
-  // Create pipeline
-  VkShaderModule vertex_module;
-  VkShaderModule fragment_module;
+  vkCmdBlitImage(
+      command_buffer,
+      src_cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      dst_cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      1,
+      &blit,
+      VK_FILTER_LINEAR);
 
-  size_t vertex_code_size;
-  unsigned char *vertex_code =
-      load_bytes_from_file(vert_path, &vertex_code_size);
+  set_image_layout(
+      command_buffer,
+      src_cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      src_range,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-  size_t fragment_code_size;
-  unsigned char *fragment_code =
-      load_bytes_from_file(frag_path, &fragment_code_size);
+  set_image_layout(
+      command_buffer,
+      dst_cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      dst_range,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
 
-  // Vertex module
-  {
-    VkShaderModuleCreateInfo create_info = {
-        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        NULL,
-        0,
-        vertex_code_size,
-        (uint32_t *)vertex_code};
+// Fills every level past the first by halving the previous one with linear
+// blits, which for exact halves is a 2x2 box filter. Level 0 must be in
+// SHADER_READ_ONLY_OPTIMAL, and all levels are left in it.
+static void cubemap_generate_mips(cubemap_t *cubemap) {
+  VkCommandBuffer command_buffer = begin_single_time_command_buffer();
 
-    VK_CHECK(
-        vkCreateShaderModule(g_device, &create_info, NULL, &vertex_module));
+  for (uint32_t level = 1; level < cubemap->mip_levels; level++) {
+    cmd_blit_cubemap_level(command_buffer, cubemap, level - 1, cubemap, level);
   }
 
-  // Fragment module
-  {
-    VkShaderModuleCreateInfo create_info = {
-        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        NULL,
-        0,
-        fragment_code_size,
-        (uint32_t *)fragment_code};
+  end_single_time_command_buffer(command_buffer);
+}
 
-    VK_CHECK(
-        vkCreateShaderModule(g_device, &create_info, NULL, &fragment_module));
-  }
+void cubemap_init_skybox_from_hdr_equirec(
+    cubemap_t *skybox_cubemap,
+    skybox_source_t *source,
+    const uint32_t width,
+    const uint32_t height) {
+  skybox_cubemap->width = width;
+  skybox_cubemap->height = height;
+  skybox_cubemap->format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  skybox_cubemap->mip_levels = cubemap_full_mip_count(width);
 
-  free(vertex_code);
-  free(fragment_code);
+  create_cubemap_image(
+      &skybox_cubemap->image,
+      &skybox_cubemap->allocation,
+      &skybox_cubemap->image_view,
+      &skybox_cubemap->sampler,
+      skybox_cubemap->format,
+      width,
+      height,
+      skybox_cubemap->mip_levels);
 
-  VkDescriptorSetLayout set_layouts[] = {
-      g_bake_cubemap_descriptor_set_layout,
-  };
+  render_equirec_to_cubemap(source, skybox_cubemap, 0);
+  cubemap_generate_mips(skybox_cubemap);
+}
 
-  VkPipelineLayout pipeline_layout;
+// Copies the faces of a cube cross or face set straight into the skybox,
+// which takes the face size of the input
+void cubemap_init_skybox_from_faces(
+    cubemap_t *skybox_cubemap, skybox_source_t *source) {
+  uint32_t face_size = source->face_size;
 
-  VkPushConstantRange push_constant_range = {};
-  push_constant_range.stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-  push_constant_range.offset = 0;
-  push_constant_range.size = 128;
+  skybox_cubemap->width = face_size;
+  skybox_cubemap->height = face_size;
+  skybox_cubemap->format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  skybox_cubemap->mip_levels = cubemap_full_mip_count(face_size);
 
-  VkPipelineLayoutCreateInfo create_info;
-  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  create_info.pNext = NULL;
-  create_info.flags = 0;
-  create_info.setLayoutCount = ARRAYSIZE(set_layouts);
-  create_info.pSetLayouts = set_layouts;
-  create_info.pushConstantRangeCount = 1;
-  create_info.pPushConstantRanges = &push_constant_range;
+  create_cubemap_image(
+      &skybox_cubemap->image,
+      &skybox_cubemap->allocation,
+      &skybox_cubemap->image_view,
+      &skybox_cubemap->sampler,
+      skybox_cubemap->format,
+      face_size,
+      face_size,
+      skybox_cubemap->mip_levels);
 
-  VK_CHECK(
-      vkCreatePipelineLayout(g_device, &create_info, NULL, &pipeline_layout));
+  size_t texel_size = 4 * sizeof(float);
+  size_t pixels_size = (size_t)source->width * source->height * texel_size;
 
-  VkPipeline pipeline;
+  VkBuffer staging_buffer;
+  VmaAllocation staging_allocation;
 
-  VkGraphicsPipelineCreateInfo pipeline_create_info =
-      default_pipeline_create_info(
-          vertex_module, fragment_module, pipeline_layout, canvas.render_pass);
+  create_buffer(
+      &staging_buffer,
+      &staging_allocation,
+      pixels_size,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VMA_MEMORY_USAGE_CPU_ONLY,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-  VK_CHECK(vkCreateGraphicsPipelines(
-      g_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &pipeline));
+  void *stagingMemoryPointer;
+  vmaMapMemory(g_gpu_allocator, staging_allocation, &stagingMemoryPointer);
+  memcpy(stagingMemoryPointer, source->pixels, pixels_size);
+  vmaUnmapMemory(g_gpu_allocator, staging_allocation);
+
+  // One region per face, picking its cell out of the whole image. Face sets
+  // are packed as a column of cells.
+  VkBufferImageCopy regions[6];
+  for (uint32_t face = 0; face < 6; face++) {
+    uint32_t cell_x = 0;
+    uint32_t cell_y = face;
+    if (source->layout == SKYBOX_LAYOUT_HORIZONTAL_CROSS) {
+      cell_x = HORIZONTAL_CROSS_CELLS[face][0];
+      cell_y = HORIZONTAL_CROSS_CELLS[face][1];
+    } else if (source->layout == SKYBOX_LAYOUT_VERTICAL_CROSS) {
+      cell_x = VERTICAL_CROSS_CELLS[face][0];
+      cell_y = VERTICAL_CROSS_CELLS[face][1];
+    }
 
-  // Allocate command buffer
-  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
-  {
-    VkCommandBufferAllocateInfo allocate_info = {};
-    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocate_info.pNext = NULL;
-    allocate_info.commandPool = g_command_pool;
-    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocate_info.commandBufferCount = 1;
+    size_t offset = ((size_t)cell_y * face_size * source->width +
+                     (size_t)cell_x * face_size) *
+                    texel_size;
 
-    vkAllocateCommandBuffers(g_device, &allocate_info, &command_buffer);
+    regions[face] = (VkBufferImageCopy){
+        offset,        // bufferOffset
+        source->width, // bufferRowLength
+        0,             // bufferImageHeight
+        {
+            VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+            0,                         // mipLevel
+            face,                      // baseArrayLayer
+            1,                         // layerCount
+        },                             // imageSubresource
+        {0, 0, 0},                     // imageOffset
+        {face_size, face_size, 1},     // imageExtent
+    };
   }
 
-  // Begin command buffer
-  VkCommandBufferBeginInfo begin_info = {};
-  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  begin_info.flags = 0;
-  begin_info.pInheritanceInfo = NULL;
-
-  VK_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info));
+  VkCommandBuffer command_buffer = begin_single_time_command_buffer();
 
   VkImageSubresourceRange subresource_range = {};
   subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1874,220 +3224,157 @@ static void render_cubemap_to_cubemap(
 
   set_image_layout(
       command_buffer,
-      source_cubemap->image,
+      skybox_cubemap->image,
       VK_IMAGE_LAYOUT_UNDEFINED,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
       subresource_range,
       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-  vkCmdBindDescriptorSets(
+  vkCmdCopyBufferToImage(
       command_buffer,
-      VK_PIPELINE_BIND_POINT_GRAPHICS,
-      pipeline_layout,
-      0, // firstSet
-      1,
-      &descriptor_set,
-      0,
-      NULL);
-
-  for (uint32_t level = 0; level < dest_cubemap->mip_levels; level++) {
-    for (size_t i = 0; i < ARRAYSIZE(camera_views); i++) {
-      canvas_begin(&canvas, command_buffer);
-
-      VkViewport viewport = (VkViewport){
-          0.0f,                                        // x
-          0.0f,                                        // y
-          (float)dest_cubemap->width / pow(2, level),  // width
-          (float)dest_cubemap->height / pow(2, level), // height
-          0.0f,                                        // minDepth
-          1.0f,                                        // maxDepth
-      };
-
-      vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-
-      pc.mvp = mat4_mul(camera_views[i], proj);
-      pc.roughness = (float)level / (float)(dest_cubemap->mip_levels - 1);
-
-      vkCmdPushConstants(
-          command_buffer,
-          pipeline_layout,
-          VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-          0,
-          sizeof(push_constant_t),
-          &pc);
-
-      vkCmdDraw(command_buffer, 36, 1, 0, 0);
-
-      canvas_end(&canvas, command_buffer);
-
-      copy_side_image_to_cubemap(
-          command_buffer, canvas.image, dest_cubemap, i, level);
-    }
-  }
-
-  VK_CHECK(vkEndCommandBuffer(command_buffer));
-
-  // Submit
-  VkPipelineStageFlags wait_dst_stage_mask =
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-
-  VkSubmitInfo submit_info = {
-      VK_STRUCTURE_TYPE_SUBMIT_INFO, // sType
-      NULL,                          // pNext
-      0,                             // waitSemaphoreCount
-      NULL,                          // pWaitSemaphores
-      &wait_dst_stage_mask,          // pWaitDstStageMask
-      1,                             // commandBufferCount
-      &command_buffer,               // pCommandBuffers
-      0,                             // signalSemaphoreCount
-      NULL,                          // pSignalSemaphores
-  };
-
-  vkQueueSubmit(g_graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-
-  VK_CHECK(vkDeviceWaitIdle(g_device));
-
-  vkFreeCommandBuffers(g_device, g_command_pool, 1, &command_buffer);
-
-  vkFreeDescriptorSets(g_device, g_descriptor_pool, 1, &descriptor_set);
+      staging_buffer,
+      skybox_cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      ARRAYSIZE(regions),
+      regions);
 
-  canvas_destroy(&canvas);
+  set_image_layout(
+      command_buffer,
+      skybox_cubemap->image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      subresource_range,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-  vkDestroyShaderModule(g_device, vertex_module, NULL);
+  end_single_time_command_buffer(command_buffer);
 
-  vkDestroyShaderModule(g_device, fragment_module, NULL);
+  vmaDestroyBuffer(g_gpu_allocator, staging_buffer, staging_allocation);
 
-  vkDestroyPipeline(g_device, pipeline, NULL);
-  vkDestroyPipelineLayout(g_device, pipeline_layout, NULL);
+  cubemap_generate_mips(skybox_cubemap);
 }
 
-static void create_cubemap_image(
-    VkImage *image,
-    VmaAllocation *allocation,
-    VkImageView *image_view,
-    VkSampler *sampler,
-    VkFormat format,
-    uint32_t width,
-    uint32_t height,
-    uint32_t levels) {
-  VkImageCreateInfo image_create_info = (VkImageCreateInfo){
-      VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-      NULL,                                // pNext
-      VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT, // flags
-      VK_IMAGE_TYPE_2D,                    // imageType
-      format,                              // format
-      {
-          width,               // width
-          height,              // height
-          1,                   // depth
-      },                       // extent
-      levels,                  // mipLevels
-      6,                       // arrayLayers
-      VK_SAMPLE_COUNT_1_BIT,   // samples
-      VK_IMAGE_TILING_OPTIMAL, // tiling
-      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
-          VK_IMAGE_USAGE_SAMPLED_BIT, // usage
-      VK_SHARING_MODE_EXCLUSIVE,      // sharingMode
-      1,                              // queueFamilyIndexCount
-      &g_graphics_queue_family_index, // pQueueFamilyIndices
-      VK_IMAGE_LAYOUT_UNDEFINED,      // initialLayout
-  };
-
-  VmaAllocationCreateInfo image_alloc_create_info = {};
-  image_alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+// Face size of the skybox level irradiance is integrated from. Irradiance is
+// so smooth that summing every texel of a 32x32 face is indistinguishable
+// from integrating the full resolution skybox.
+#define IRRADIANCE_SOURCE_SIZE 32
 
-  VK_CHECK(vmaCreateImage(
-      g_gpu_allocator,
-      &image_create_info,
-      &image_alloc_create_info,
-      image,
-      allocation,
-      NULL));
+// Fills a storage buffer with the sample table of the irradiance stage: the
+// unit direction to the center of every texel of a face_size skybox level,
+// with the solid angle of the texel in w. Doing this once saves every
+// irradiance texel from working it out for all source texels.
+static void create_irradiance_samples(
+    uint32_t face_size, VkBuffer *buffer, VmaAllocation *allocation) {
+  size_t sample_count = (size_t)face_size * face_size * CUBE_FACE_COUNT;
 
-  VkImageViewCreateInfo image_view_create_info = (VkImageViewCreateInfo){
-      VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-      NULL,
-      0,                       // flags
-      *image,                  // image
-      VK_IMAGE_VIEW_TYPE_CUBE, // viewType
-      format,                  // format
-      {
-          VK_COMPONENT_SWIZZLE_IDENTITY, // r
-          VK_COMPONENT_SWIZZLE_IDENTITY, // g
-          VK_COMPONENT_SWIZZLE_IDENTITY, // b
-          VK_COMPONENT_SWIZZLE_IDENTITY, // a
-      },                                 // components
-      {
-          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
-          0,                         // baseMipLevel
-          levels,                    // levelCount
-          0,                         // baseArrayLayer
-          6,                         // layerCount
-      },                             // subresourceRange
-  };
+  create_buffer(
+      buffer,
+      allocation,
+      sample_count * 4 * sizeof(float),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VMA_MEMORY_USAGE_CPU_TO_GPU,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-  VK_CHECK(
-      vkCreateImageView(g_device, &image_view_create_info, NULL, image_view));
+  void *memory_pointer;
+  vmaMapMemory(g_gpu_allocator, *allocation, &memory_pointer);
 
-  VkSamplerCreateInfo sampler_create_info = (VkSamplerCreateInfo){
-      VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-      NULL,
-      0,                                       // flags
-      VK_FILTER_LINEAR,                        // magFilter
-      VK_FILTER_LINEAR,                        // minFilter
-      VK_SAMPLER_MIPMAP_MODE_LINEAR,           // mipmapMode
-      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeU
-      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeV
-      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, // addressModeW
-      0.0f,                                    // mipLodBias
-      VK_FALSE,                                // anisotropyEnable
-      1.0f,                                    // maxAnisotropy
-      VK_FALSE,                                // compareEnable
-      VK_COMPARE_OP_NEVER,                     // compareOp
-      0.0f,                                    // minLod
-      (float)levels,                           // maxLod
-      VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK, // borderColor
-      VK_FALSE,                                // unnormalizedCoordinates
-  };
+  float texel_extent = 2.0f / (float)face_size;
 
-  VK_CHECK(vkCreateSampler(g_device, &sampler_create_info, NULL, sampler));
+  float *sample = memory_pointer;
+  for (uint32_t face = 0; face < CUBE_FACE_COUNT; face++) {
+    for (uint32_t y = 0; y < face_size; y++) {
+      for (uint32_t x = 0; x < face_size; x++) {
+        float direction[3];
+        cube_texel_direction(face, face_size, x, y, direction);
+
+        float length = sqrtf(
+            direction[0] * direction[0] + direction[1] * direction[1] +
+            direction[2] * direction[2]);
+
+        sample[0] = direction[0] / length;
+        sample[1] = direction[1] / length;
+        sample[2] = direction[2] / length;
+        sample[3] =
+            texel_extent * texel_extent / (length * length * length);
+        sample += 4;
+      }
+    }
+  }
+
+  vmaUnmapMemory(g_gpu_allocator, *allocation);
 }
 
-void cubemap_init_skybox_from_hdr_equirec(
+void cubemap_init_irradiance_from_skybox(
+    cubemap_t *irradiance_cubemap,
     cubemap_t *skybox_cubemap,
-    const char *path,
     const uint32_t width,
-    const uint32_t height,
-    const char *vert_path,
-    const char *frag_path) {
-  skybox_cubemap->width = width;
-  skybox_cubemap->height = height;
-  skybox_cubemap->format = VK_FORMAT_R32G32B32A32_SFLOAT;
-  skybox_cubemap->mip_levels = 1;
+    const uint32_t height) {
+  irradiance_cubemap->width = width;
+  irradiance_cubemap->height = height;
+  irradiance_cubemap->format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  irradiance_cubemap->mip_levels = 1;
 
   create_cubemap_image(
-      &skybox_cubemap->image,
-      &skybox_cubemap->allocation,
-      &skybox_cubemap->image_view,
-      &skybox_cubemap->sampler,
-      skybox_cubemap->format,
+      &irradiance_cubemap->image,
+      &irradiance_cubemap->allocation,
+      &irradiance_cubemap->image_view,
+      &irradiance_cubemap->sampler,
+      irradiance_cubemap->format,
       width,
       height,
       1);
 
-  render_equirec_to_cubemap(path, skybox_cubemap, 0, vert_path, frag_path);
+  push_constant_t pc = {};
+  pc.source_level =
+      cubemap_level_for_size(skybox_cubemap, IRRADIANCE_SOURCE_SIZE);
+
+  VkBuffer samples;
+  VmaAllocation samples_allocation;
+  create_irradiance_samples(
+      skybox_cubemap->width >> pc.source_level, &samples, &samples_allocation);
+
+  render_cubemap_to_cubemap(
+      irradiance_cubemap,
+      0,
+      1,
+      skybox_cubemap,
+      &pc,
+      samples,
+      g_bake_pipelines[BAKE_PIPELINE_IRRADIANCE]);
+
+  vmaDestroyBuffer(g_gpu_allocator, samples, samples_allocation);
 }
 
-void cubemap_init_irradiance_from_skybox(
+// Projects the skybox onto order 2 spherical harmonics, on the CPU. Reads
+// back the same small level the irradiance convolution integrates, which
+// is plenty for 9 coefficients. At 32x32 that is 96 KiB and the projection
+// takes a fraction of a millisecond, so a GPU reduction would save nothing:
+// its 108 byte result needs the same submit and wait to come back.
+void skybox_project_sh9(cubemap_t *skybox_cubemap, sh9_t *sh) {
+  uint32_t level =
+      cubemap_level_for_size(skybox_cubemap, IRRADIANCE_SOURCE_SIZE);
+  uint32_t face_size = skybox_cubemap->width >> level;
+
+  float *faces = malloc(
+      (size_t)face_size * face_size * CUBE_FACE_COUNT * 4 * sizeof(float));
+  assert(faces != NULL);
+
+  download_cubemap_faces(skybox_cubemap, level, 0, CUBE_FACE_COUNT, faces);
+  sh9_project_cubemap(faces, face_size, sh);
+
+  free(faces);
+}
+
+// Reconstructs the irradiance cubemap from the radiance coefficients of the
+// skybox, on the CPU. Gives the same quantity as the convolution pipeline.
+// At 64x64 this is about a millisecond plus a 384 KiB upload, cheaper than
+// creating and recording another bake pipeline for it.
+void cubemap_init_irradiance_from_sh9(
     cubemap_t *irradiance_cubemap,
-    cubemap_t *skybox_cubemap,
+    const sh9_t *radiance_sh,
     const uint32_t width,
-    const uint32_t height,
-    const char *vert_path,
-    const char *frag_path) {
+    const uint32_t height) {
   irradiance_cubemap->width = width;
   irradiance_cubemap->height = height;
   irradiance_cubemap->format = VK_FORMAT_R32G32B32A32_SFLOAT;
@@ -2103,8 +3390,418 @@ void cubemap_init_irradiance_from_skybox(
       height,
       1);
 
-  render_cubemap_to_cubemap(
-      irradiance_cubemap, skybox_cubemap, vert_path, frag_path);
+  sh9_t irradiance_sh;
+  sh9_radiance_to_irradiance(radiance_sh, &irradiance_sh);
+
+  float *faces =
+      malloc((size_t)width * height * CUBE_FACE_COUNT * 4 * sizeof(float));
+  assert(faces != NULL);
+
+  float *texel = faces;
+  for (uint32_t face = 0; face < CUBE_FACE_COUNT; face++) {
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+        float direction[3];
+        cube_texel_direction(face, width, x, y, direction);
+
+        float length = sqrtf(
+            direction[0] * direction[0] + direction[1] * direction[1] +
+            direction[2] * direction[2]);
+        direction[0] /= length;
+        direction[1] /= length;
+        direction[2] /= length;
+
+        sh9_evaluate(&irradiance_sh, direction, texel);
+
+        // Ringing of the truncated series can dip below zero opposite very
+        // bright lights
+        texel[0] = fmaxf(texel[0], 0.0f);
+        texel[1] = fmaxf(texel[1], 0.0f);
+        texel[2] = fmaxf(texel[2], 0.0f);
+        texel[3] = 1.0f;
+        texel += 4;
+      }
+    }
+  }
+
+  upload_cubemap_level(irradiance_cubemap, 0, faces);
+
+  free(faces);
+}
+
+// Fewest GGX samples a radiance texel takes. Filtered importance sampling
+// reads the blurrier skybox levels for wide lobes, which keeps the rough
+// levels smooth with this many.
+#define RADIANCE_MIN_SAMPLE_COUNT 64
+
+// Sample count of each radiance level, for level 1 taking sample_count.
+// Roughness 0 is a mirror, one sample along the normal is exact (the level
+// is blitted rather than baked anyway). Past that the count halves with
+// every level, as lobes get wider and the filtered skybox levels they read
+// smoother, down to RADIANCE_MIN_SAMPLE_COUNT.
+static uint32_t
+radiance_level_sample_count(uint32_t level, uint32_t sample_count) {
+  if (level == 0) {
+    return 1;
+  }
+
+  uint32_t count = sample_count >> (level - 1);
+  if (count < RADIANCE_MIN_SAMPLE_COUNT) {
+    count = RADIANCE_MIN_SAMPLE_COUNT;
+  }
+  if (count > sample_count) {
+    count = sample_count;
+  }
+  return count;
+}
+
+// Radical inverse of i in base 2, for Hammersley points
+static float radical_inverse_vdc(uint32_t bits) {
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return (float)bits * 2.3283064365386963e-10f; // / 0x100000000
+}
+
+// Fills a storage buffer with the GGX samples of the radiance levels from
+// first_level up to, but not including, end_level, generated from the
+// roughness and sample count in their push constants. With V = N, which the
+// radiance stage assumes, the samples don't depend on the texel: each is the
+// direction to sample in tangent space with N along z, its NdotL being z,
+// and the skybox level filtered importance sampling reads it from in w.
+// Samples below the horizon are dropped. The sample count and offset of each
+// level are updated to match the table. With decorrelate set, the point set
+// of each level is shifted by its own offset (a Cranley-Patterson
+// rotation), so levels of the same roughness give independent estimates of
+// the same integral. When texels average several such sets,
+// lod_sample_counts holds the total samples per texel of each level to pick
+// LODs for, otherwise it is NULL and LODs are picked for the level's own
+// count.
+static void create_radiance_samples(
+    push_constant_t *level_constants,
+    uint32_t first_level,
+    uint32_t end_level,
+    uint32_t skybox_size,
+    bool decorrelate,
+    const uint32_t *lod_sample_counts,
+    VkBuffer *buffer,
+    VmaAllocation *allocation) {
+  size_t max_sample_count = 0;
+  for (uint32_t level = first_level; level < end_level; level++) {
+    max_sample_count += level_constants[level].sample_count;
+  }
+
+  float *samples = malloc(max_sample_count * 4 * sizeof(float));
+  assert(samples != NULL);
+
+  float sa_texel = 4.0f * PI / (6.0f * (float)skybox_size * (float)skybox_size);
+
+  uint32_t table_size = 0;
+  for (uint32_t level = first_level; level < end_level; level++) {
+    push_constant_t *pc = &level_constants[level];
+    uint32_t sample_count = pc->sample_count;
+    uint32_t lod_sample_count =
+        lod_sample_counts != NULL ? lod_sample_counts[level] : sample_count;
+    float a = pc->roughness * pc->roughness;
+    float a2 = a * a;
+
+    pc->sample_offset = table_size;
+
+    // Offsets from the R2 sequence, which are well spread for any number of
+    // levels
+    float shift_u = 0.0f;
+    float shift_v = 0.0f;
+    if (decorrelate) {
+      float index = (float)(level - first_level);
+      shift_u = fmodf(index * 0.7548776662466927f, 1.0f);
+      shift_v = fmodf(index * 0.5698402909980532f, 1.0f);
+    }
+
+    for (uint32_t i = 0; i < sample_count; i++) {
+      // Halfway vector from the i-th Hammersley point
+      float u = fmodf((float)i / (float)sample_count + shift_u, 1.0f);
+      float xi = fmodf(radical_inverse_vdc(i) + shift_v, 1.0f);
+      float phi = 2.0f * PI * u;
+      float cos_theta = sqrtf((1.0f - xi) / (1.0f + (a2 - 1.0f) * xi));
+      float sin_theta = sqrtf(1.0f - cos_theta * cos_theta);
+
+      float h[3] = {cosf(phi) * sin_theta, sinf(phi) * sin_theta, cos_theta};
+
+      // L = reflect(-V, H) with V = N = z
+      float l[3] = {
+          2.0f * cos_theta * h[0],
+          2.0f * cos_theta * h[1],
+          2.0f * cos_theta * h[2] - 1.0f,
+      };
+
+      float n_dot_l = l[2];
+      if (n_dot_l <= 0.0f) {
+        continue;
+      }
+
+      // pdf of L, with NdotH = HdotV = cos_theta
+      float d_denom = cos_theta * cos_theta * (a2 - 1.0f) + 1.0f;
+      float d = a2 / (PI * d_denom * d_denom);
+      float pdf = d / 4.0f + 0.0001f;
+
+      // Skybox level whose texels cover the solid angle of the sample
+      float sa_sample = 1.0f / ((float)lod_sample_count * pdf + 0.0001f);
+      float lod = pc->roughness == 0.0f
+                      ? 0.0f
+                      : fmaxf(0.5f * log2f(sa_sample / sa_texel), 0.0f);
+
+      float *sample = &samples[(size_t)table_size * 4];
+      sample[0] = l[0];
+      sample[1] = l[1];
+      sample[2] = l[2];
+      sample[3] = lod;
+      table_size++;
+    }
+
+    pc->sample_count = table_size - pc->sample_offset;
+  }
+
+  size_t table_bytes = (size_t)(table_size > 0 ? table_size : 1) * 4 *
+                       sizeof(float);
+
+  create_buffer(
+      buffer,
+      allocation,
+      table_bytes,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VMA_MEMORY_USAGE_CPU_TO_GPU,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  void *memory_pointer;
+  vmaMapMemory(g_gpu_allocator, *allocation, &memory_pointer);
+  memcpy(memory_pointer, samples, (size_t)table_size * 4 * sizeof(float));
+  vmaUnmapMemory(g_gpu_allocator, *allocation);
+
+  free(samples);
+}
+
+// Filters the rough levels of a radiance cubemap each from the level before
+// it, level 0 being filled already. GGX lobes roughly compose like Gaussians
+// of variance alpha squared, so convolving the previous level with the lobe
+// of alpha sqrt(alpha^2 - previous_alpha^2) gives the level's own lobe. That
+// lobe is narrow at every level, and RADIANCE_MIN_SAMPLE_COUNT samples of it
+// are enough. Levels are baked one submit at a time, reading a view of only
+// the previous level while the next one is rendered, so the samples can't
+// reach for blurrier levels and their LODs are clamped to that one.
+static void prefilter_radiance_from_previous_levels(
+    cubemap_t *radiance_cubemap,
+    push_constant_t *level_constants) {
+  uint32_t mip_levels = radiance_cubemap->mip_levels;
+
+  for (uint32_t level = 1; level < mip_levels; level++) {
+    float roughness = (float)level / (float)(mip_levels - 1);
+    float previous_roughness = (float)(level - 1) / (float)(mip_levels - 1);
+    float alpha = roughness * roughness;
+    float previous_alpha = previous_roughness * previous_roughness;
+    float kernel_alpha =
+        sqrtf(alpha * alpha - previous_alpha * previous_alpha);
+
+    push_constant_t *pc = &level_constants[level];
+    pc->roughness = sqrtf(kernel_alpha);
+    pc->sample_count = RADIANCE_MIN_SAMPLE_COUNT;
+
+    cubemap_t previous_level = *radiance_cubemap;
+    previous_level.width = radiance_cubemap->width >> (level - 1);
+    previous_level.height = radiance_cubemap->height >> (level - 1);
+    previous_level.mip_levels = 1;
+    create_cubemap_level_view(
+        radiance_cubemap, level - 1, &previous_level.image_view);
+
+    VkBuffer samples;
+    VmaAllocation samples_allocation;
+    create_radiance_samples(
+        level_constants,
+        level,
+        level + 1,
+        previous_level.width,
+        false,
+        NULL,
+        &samples,
+        &samples_allocation);
+
+    render_cubemap_to_cubemap(
+        radiance_cubemap,
+        level,
+        1,
+        &previous_level,
+        level_constants,
+        samples,
+        g_bake_pipelines[BAKE_PIPELINE_RADIANCE]);
+
+    vmaDestroyBuffer(g_gpu_allocator, samples, samples_allocation);
+    vkDestroyImageView(g_device, previous_level.image_view, NULL);
+  }
+}
+
+// Samples per batch of progressive radiance sampling
+#define RADIANCE_BATCH_SAMPLE_COUNT 64
+
+// Luminance below which progressive radiance sampling measures absolute
+// rather than relative error, so black texels don't need infinite samples
+#define RADIANCE_ERROR_LUMINANCE_FLOOR 1e-3f
+
+static float luminance(const float *rgb) {
+  return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+}
+
+// Filters the rough levels of a radiance cubemap from the skybox in batches
+// of RADIANCE_BATCH_SAMPLE_COUNT samples, a submit each, until the estimated
+// error of every face is at most max_error or it has taken sample_count
+// samples. Each batch of a level uses a differently rotated point set, so
+// batch results are independent estimates of the level: their running mean
+// is the result, and their variance the squared standard error of it for
+// every texel. A face's error is the RMS of those errors relative to texel
+// luminance, and faces that meet max_error are skipped by later batches.
+// Batches read the skybox levels the fixed count bake of the level reads, so
+// both converge to the same filtered result.
+static void prefilter_radiance_progressive(
+    cubemap_t *radiance_cubemap,
+    cubemap_t *skybox_cubemap,
+    push_constant_t *level_constants,
+    uint32_t sample_count,
+    float max_error) {
+  uint32_t mip_levels = radiance_cubemap->mip_levels;
+  uint32_t all_faces = (1u << CUBE_FACE_COUNT) - 1;
+
+  // At least two batches, variance can't be estimated from one
+  uint32_t max_batch_count = sample_count / RADIANCE_BATCH_SAMPLE_COUNT;
+  if (max_batch_count < 2) {
+    max_batch_count = 2;
+  }
+
+  // Samples of every batch of every level, batch b of level l being set
+  // (l - 1) * max_batch_count + b
+  uint32_t set_count = (mip_levels - 1) * max_batch_count;
+  push_constant_t *sets = calloc(set_count, sizeof(push_constant_t));
+  uint32_t *lod_sample_counts = malloc(set_count * sizeof(uint32_t));
+  assert(sets != NULL && lod_sample_counts != NULL);
+  for (uint32_t level = 1; level < mip_levels; level++) {
+    for (uint32_t batch = 0; batch < max_batch_count; batch++) {
+      uint32_t set = (level - 1) * max_batch_count + batch;
+      sets[set].roughness = level_constants[level].roughness;
+      sets[set].sample_count = RADIANCE_BATCH_SAMPLE_COUNT;
+      lod_sample_counts[set] = level_constants[level].sample_count;
+    }
+  }
+
+  VkBuffer samples;
+  VmaAllocation samples_allocation;
+  create_radiance_samples(
+      sets,
+      0,
+      set_count,
+      skybox_cubemap->width,
+      true,
+      lod_sample_counts,
+      &samples,
+      &samples_allocation);
+  free(lod_sample_counts);
+
+  for (uint32_t level = 1; level < mip_levels; level++) {
+    uint32_t size = radiance_cubemap->width >> level;
+    size_t face_texel_count = (size_t)size * size;
+    size_t texel_count = face_texel_count * CUBE_FACE_COUNT;
+
+    float *batch_pixels = malloc(texel_count * 4 * sizeof(float));
+    float *mean = calloc(texel_count * 4, sizeof(float));
+    float *luminance_m2 = calloc(texel_count, sizeof(float));
+    assert(batch_pixels != NULL && mean != NULL && luminance_m2 != NULL);
+
+    uint32_t face_batch_counts[CUBE_FACE_COUNT] = {0};
+    uint32_t skip_faces = 0;
+
+    for (uint32_t batch = 0;
+         batch < max_batch_count && skip_faces != all_faces;
+         batch++) {
+      level_constants[level] = sets[(level - 1) * max_batch_count + batch];
+      level_constants[level].skip_faces = skip_faces;
+
+      render_cubemap_to_cubemap(
+          radiance_cubemap,
+          level,
+          1,
+          skybox_cubemap,
+          level_constants,
+          samples,
+          g_bake_pipelines[BAKE_PIPELINE_RADIANCE]);
+
+      // Read back only the faces the batch rendered, a run of adjacent ones
+      // at a time
+      for (uint32_t face = 0; face < CUBE_FACE_COUNT;) {
+        if (skip_faces & (1u << face)) {
+          face++;
+          continue;
+        }
+
+        uint32_t run_end = face + 1;
+        while (run_end < CUBE_FACE_COUNT && !(skip_faces & (1u << run_end))) {
+          run_end++;
+        }
+
+        download_cubemap_faces(
+            radiance_cubemap,
+            level,
+            face,
+            run_end - face,
+            &batch_pixels[face * face_texel_count * 4]);
+        face = run_end;
+      }
+
+      for (uint32_t face = 0; face < CUBE_FACE_COUNT; face++) {
+        if (skip_faces & (1u << face)) {
+          continue;
+        }
+
+        uint32_t n = ++face_batch_counts[face];
+        float error_sum = 0.0f;
+
+        for (size_t i = face * face_texel_count;
+             i < (face + 1) * face_texel_count;
+             i++) {
+          float *x = &batch_pixels[i * 4];
+          float *m = &mean[i * 4];
+
+          // Welford's update, luminance being linear in the color
+          float delta = luminance(x) - luminance(m);
+          for (uint32_t c = 0; c < 3; c++) {
+            m[c] += (x[c] - m[c]) / (float)n;
+          }
+          luminance_m2[i] += delta * (luminance(x) - luminance(m));
+
+          if (n >= 2) {
+            float mean_variance = luminance_m2[i] / (float)((n - 1) * n);
+            float reference =
+                fmaxf(luminance(m), RADIANCE_ERROR_LUMINANCE_FLOOR);
+            error_sum += mean_variance / (reference * reference);
+          }
+        }
+
+        if (n >= 2 &&
+            sqrtf(error_sum / (float)face_texel_count) <= max_error) {
+          skip_faces |= 1u << face;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < texel_count; i++) {
+      mean[i * 4 + 3] = 1.0f;
+    }
+    upload_cubemap_level(radiance_cubemap, level, mean);
+
+    free(batch_pixels);
+    free(mean);
+    free(luminance_m2);
+  }
+
+  vmaDestroyBuffer(g_gpu_allocator, samples, samples_allocation);
+  free(sets);
 }
 
 void cubemap_init_radiance_from_skybox(
@@ -2112,9 +3809,10 @@ void cubemap_init_radiance_from_skybox(
     cubemap_t *skybox_cubemap,
     const uint32_t width,
     const uint32_t height,
-    const char *vert_path,
-    const char *frag_path,
-    uint32_t mip_levels) {
+    uint32_t mip_levels,
+    radiance_mode_t mode,
+    uint32_t sample_count,
+    float max_error) {
   radiance_cubemap->width = width;
   radiance_cubemap->height = height;
   radiance_cubemap->format = VK_FORMAT_R32G32B32A32_SFLOAT;
@@ -2130,8 +3828,64 @@ void cubemap_init_radiance_from_skybox(
       height,
       radiance_cubemap->mip_levels);
 
-  render_cubemap_to_cubemap(
-      radiance_cubemap, skybox_cubemap, vert_path, frag_path);
+  push_constant_t *level_constants =
+      calloc(mip_levels, sizeof(push_constant_t));
+  assert(level_constants != NULL);
+  for (uint32_t level = 0; level < mip_levels; level++) {
+    level_constants[level].roughness = (float)level / (float)(mip_levels - 1);
+    level_constants[level].sample_count =
+        radiance_level_sample_count(level, sample_count);
+  }
+
+  // Level 0 is a mirror, which is just the skybox resampled. Blitting it
+  // from the closest skybox level saves the level with the most texels
+  // from being convolved.
+  uint32_t blit_source_level = 0;
+  while (blit_source_level + 1 < skybox_cubemap->mip_levels &&
+         (skybox_cubemap->width >> (blit_source_level + 1)) >= width) {
+    blit_source_level++;
+  }
+
+  VkCommandBuffer command_buffer = begin_single_time_command_buffer();
+  cmd_blit_cubemap_level(
+      command_buffer, skybox_cubemap, blit_source_level, radiance_cubemap, 0);
+  end_single_time_command_buffer(command_buffer);
+
+  if (mip_levels > 1 && mode == RADIANCE_MODE_HIERARCHICAL) {
+    prefilter_radiance_from_previous_levels(radiance_cubemap, level_constants);
+  } else if (mip_levels > 1 && max_error > 0.0f) {
+    prefilter_radiance_progressive(
+        radiance_cubemap,
+        skybox_cubemap,
+        level_constants,
+        sample_count,
+        max_error);
+  } else if (mip_levels > 1) {
+    VkBuffer samples;
+    VmaAllocation samples_allocation;
+    create_radiance_samples(
+        level_constants,
+        1,
+        mip_levels,
+        skybox_cubemap->width,
+        false,
+        NULL,
+        &samples,
+        &samples_allocation);
+
+    render_cubemap_to_cubemap(
+        radiance_cubemap,
+        1,
+        mip_levels - 1,
+        skybox_cubemap,
+        level_constants,
+        samples,
+        g_bake_pipelines[BAKE_PIPELINE_RADIANCE]);
+
+    vmaDestroyBuffer(g_gpu_allocator, samples, samples_allocation);
+  }
+
+  free(level_constants);
 }
 
 void cubemap_destroy(cubemap_t *cubemap) {
@@ -2161,100 +3915,48 @@ void save_cubemap_mem(
     env_save_bundle_t *bundle,
     uint32_t layer,
     uint32_t level) {
-  size_t hdr_size = cubemap->width * cubemap->height * 4 * sizeof(float);
-
-  VkBuffer staging_buffer;
-  VmaAllocation staging_allocation;
-
-  create_buffer(
-      &staging_buffer,
-      &staging_allocation,
-      hdr_size,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-      VMA_MEMORY_USAGE_CPU_ONLY,
-      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-  void *staging_memory_pointer;
-  vmaMapMemory(g_gpu_allocator, staging_allocation, &staging_memory_pointer);
-
-  VkCommandBuffer command_buffer = begin_single_time_command_buffer();
-
-  VkImageSubresourceRange subresource_range = {};
-  subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  subresource_range.baseMipLevel = level;
-  subresource_range.levelCount = 1;
-  subresource_range.baseArrayLayer = layer;
-  subresource_range.layerCount = 1;
-
-  set_image_layout(
-      command_buffer,
-      cubemap->image,
-      VK_IMAGE_LAYOUT_UNDEFINED,
-      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      subresource_range,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-
-  VkBufferImageCopy region = (VkBufferImageCopy){
-      0, // bufferOffset
-      0, // bufferRowLength
-      0, // bufferImageHeight
-      {
-          VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
-          level,                     // mipLevel
-          layer,                     // baseArrayLayer
-          1,                         // layerCount
-      },                             // imageSubresource
-      {0, 0, 0},                     // imageOffset
-      {cubemap->width / pow(2, level),
-       cubemap->height / pow(2, level),
-       1}, // imageExtent
-  };
+  uint32_t width = cubemap->width >> level;
+  uint32_t height = cubemap->height >> level;
 
-  vkCmdCopyImageToBuffer(
-      command_buffer,
-      cubemap->image,
-      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      staging_buffer,
-      1,
-      &region);
-
-  set_image_layout(
-      command_buffer,
-      cubemap->image,
-      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-      subresource_range,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+  float *pixels = malloc((size_t)width * height * 4 * sizeof(float));
+  assert(pixels != NULL);
 
-  end_single_time_command_buffer(command_buffer);
-
-  VK_CHECK(vkDeviceWaitIdle(g_device));
+  download_cubemap_faces(cubemap, level, layer, 1, pixels);
 
   // Save side
   stbi_write_hdr_to_func(
-      image_write_func,
-      bundle,
-      (int)cubemap->width / pow(2, level),
-      (int)cubemap->height / pow(2, level),
-      4,
-      (float *)staging_memory_pointer);
+      image_write_func, bundle, (int)width, (int)height, 4, pixels);
 
-  VK_CHECK(vkDeviceWaitIdle(g_device));
-  vmaDestroyBuffer(g_gpu_allocator, staging_buffer, staging_allocation);
+  free(pixels);
 }
 
+// radiance_sh holds the radiance coefficients of the skybox, whose
+// irradiance goes in an optional chunk after the layers, or is NULL to leave
+// them out of the file
 void env_file_write(
     const char *path,
     cubemap_t *skybox_cubemap,
     cubemap_t *irradiance_cubemap,
-    cubemap_t *radiance_cubemap) {
+    cubemap_t *radiance_cubemap,
+    const sh9_t *radiance_sh) {
   assert(ENV_MAX_RADIANCE_MIPMAPS >= radiance_cubemap->mip_levels);
+  assert(ENV_SH_COEFFICIENT_COUNT == SH9_COEFFICIENT_COUNT);
 
   env_file_header_t header = {};
   header.radiance_mip_count = radiance_cubemap->mip_levels;
 
+  env_file_sh_chunk_t sh_chunk = {};
+  if (radiance_sh != NULL) {
+    sh9_t irradiance_sh;
+    sh9_radiance_to_irradiance(radiance_sh, &irradiance_sh);
+
+    sh_chunk.magic = ENV_SH_CHUNK_MAGIC;
+    memcpy(
+        sh_chunk.sh_irradiance,
+        irradiance_sh.coefficients,
+        sizeof(sh_chunk.sh_irradiance));
+  }
+
   unsigned char *skybox_layer_datas[6];
   unsigned char *irradiance_layer_datas[6];
   unsigned char *radiance_layer_datas[ENV_MAX_RADIANCE_MIPMAPS][6];
@@ -2292,6 +3994,9 @@ void env_file_write(
       file_size += header.radiance_layer_sizes[level][layer];
     }
   }
+  if (radiance_sh != NULL) {
+    file_size += sizeof(sh_chunk);
+  }
 
   unsigned char *data = calloc(1, file_size);
   memcpy(data, &header, sizeof(header));
@@ -2319,6 +4024,10 @@ void env_file_write(
     }
   }
 
+  if (radiance_sh != NULL) {
+    memcpy(&data[current_pos], &sh_chunk, sizeof(sh_chunk));
+  }
+
   FILE *file = fopen(path, "w+");
 
   fwrite(data, file_size, 1, file);
@@ -2342,58 +4051,215 @@ void env_file_write(
   }
 }
 
+static void print_usage(const char *program) {
+  printf(
+      "Usage: %s [options] <path-to-input> <path-to-output.env>\n"
+      "\n"
+      "The input is an equirect, a horizontal or vertical cube cross, or a\n"
+      "set of six faces given as a path with %%s standing for px, nx, py,\n"
+      "ny, pz and nz.\n"
+      "\n"
+      "Options:\n"
+      "  --cpu-decode                 Decode .hdr pixels to floats on the CPU\n"
+      "  --downsample=<box|lanczos>   Filter .hdr inputs larger than the\n"
+      "                               skybox needs down while decoding them\n"
+      "  --source-format=<rgba16f|b10g11r11|rgba32f>\n"
+      "                               Format float equirects are kept and\n"
+      "                               uploaded in (default rgba32f)\n"
+      "  --backend=<graphics|compute> Bake with render passes or compute\n"
+      "                               dispatches (default graphics)\n"
+      "  --irradiance=<convolve|sh>   Compute irradiance by convolution or\n"
+      "                               from spherical harmonics (default\n"
+      "                               convolve)\n"
+      "  --sh-irradiance              Store the spherical harmonics of the\n"
+      "                               irradiance in the .env too\n"
+      "  --radiance=<skybox|hierarchical>\n"
+      "                               Filter each radiance level from the\n"
+      "                               skybox or from the level before it\n"
+      "                               (default skybox)\n"
+      "  --radiance-samples=<count>   GGX samples per texel of the first\n"
+      "                               rough radiance level, halved for\n"
+      "                               each level after it (default 512)\n"
+      "  --radiance-error=<error>     Sample radiance from the skybox in\n"
+      "                               batches until each face is within\n"
+      "                               this relative error, taking at most\n"
+      "                               --radiance-samples per texel\n",
+      program);
+}
+
+static bool parse_options(bake_options_t *options, int argc, char *argv[]) {
+  *options = (bake_options_t){};
+  options->source_format = HDR_PIXEL_FORMAT_RGBA32F;
+  options->radiance_sample_count = 512;
+
+  int positional_count = 0;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+
+    if (strcmp(arg, "--cpu-decode") == 0) {
+      options->cpu_decode = true;
+    } else if (strcmp(arg, "--downsample=box") == 0) {
+      options->downsample = true;
+      options->downsample_filter = HDR_FILTER_BOX;
+    } else if (strcmp(arg, "--downsample=lanczos") == 0) {
+      options->downsample = true;
+      options->downsample_filter = HDR_FILTER_LANCZOS3;
+    } else if (strcmp(arg, "--source-format=rgba16f") == 0) {
+      options->source_format = HDR_PIXEL_FORMAT_RGBA16F;
+    } else if (strcmp(arg, "--source-format=b10g11r11") == 0) {
+      options->source_format = HDR_PIXEL_FORMAT_B10G11R11;
+    } else if (strcmp(arg, "--source-format=rgba32f") == 0) {
+      options->source_format = HDR_PIXEL_FORMAT_RGBA32F;
+    } else if (strcmp(arg, "--backend=graphics") == 0) {
+      options->backend = BAKE_BACKEND_GRAPHICS;
+    } else if (strcmp(arg, "--backend=compute") == 0) {
+      options->backend = BAKE_BACKEND_COMPUTE;
+    } else if (strcmp(arg, "--irradiance=convolve") == 0) {
+      options->irradiance_mode = IRRADIANCE_MODE_CONVOLVE;
+    } else if (strcmp(arg, "--irradiance=sh") == 0) {
+      options->irradiance_mode = IRRADIANCE_MODE_SH;
+    } else if (strcmp(arg, "--sh-irradiance") == 0) {
+      options->sh_irradiance = true;
+    } else if (strcmp(arg, "--radiance=skybox") == 0) {
+      options->radiance_mode = RADIANCE_MODE_SKYBOX;
+    } else if (strcmp(arg, "--radiance=hierarchical") == 0) {
+      options->radiance_mode = RADIANCE_MODE_HIERARCHICAL;
+    } else if (strncmp(arg, "--radiance-samples=", 19) == 0) {
+      int count = atoi(arg + 19);
+      if (count <= 0) {
+        printf("Invalid sample count %s\n", arg + 19);
+        return false;
+      }
+      options->radiance_sample_count = (uint32_t)count;
+    } else if (strncmp(arg, "--radiance-error=", 17) == 0) {
+      float error = (float)atof(arg + 17);
+      if (!(error > 0.0f)) {
+        printf("Invalid error %s\n", arg + 17);
+        return false;
+      }
+      options->radiance_max_error = error;
+    } else if (strncmp(arg, "--", 2) == 0) {
+      printf("Unknown option %s\n", arg);
+      return false;
+    } else if (positional_count == 0) {
+      options->in_path = arg;
+      positional_count++;
+    } else if (positional_count == 1) {
+      options->out_path = arg;
+      positional_count++;
+    } else {
+      return false;
+    }
+  }
+
+  return positional_count == 2;
+}
+
 int main(int argc, char *argv[]) {
-  if (argc <= 2) {
-    // TODO: print help
-    printf("Usage: %s <path-to-equirec.hdr> <path-to-output.env>\n", argv[0]);
+  bake_options_t options;
+  if (!parse_options(&options, argc, argv)) {
+    print_usage(argv[0]);
     return 0;
   }
 
-  vulkan_setup();
-
-  char *in_path = argv[1];
-  char *out_path = argv[2];
+  const char *in_path = options.in_path;
+  const char *out_path = options.out_path;
   uint32_t width = 512;
   uint32_t height = 512;
 
-  // Skybox
+  // Read and decode the input on its own thread while the device is created
+  // and the pipelines are compiled, nothing needs the GPU before all of them
+  // are done. Radiance equirects that fit in one tile wait for the device,
+  // then are decoded straight into a staging buffer while the pipelines
+  // are compiled.
+  skybox_source_t source;
+  staging_handoff_t staging_handoff = {
+      .mutex = PTHREAD_MUTEX_INITIALIZER,
+      .cond = PTHREAD_COND_INITIALIZER,
+  };
+  skybox_load_job_t load_job = {
+      .source = &source,
+      .path = in_path,
+      .face_size = width,
+      .options = &options,
+      .handoff = &staging_handoff,
+  };
+
+  pthread_t load_thread;
+  bool load_threaded = pthread_create(
+                           &load_thread,
+                           NULL,
+                           skybox_source_load_worker,
+                           &load_job) == 0;
+  if (!load_threaded) {
+    // Nobody could provide the staging buffer in time
+    load_job.handoff = NULL;
+    skybox_source_load_worker(&load_job);
+  }
+
+  shader_code_t shader_codes[BAKE_PIPELINE_COUNT][3];
+  load_bake_shaders(shader_codes, options.backend);
+
+  vulkan_setup(options.backend);
+  if (load_threaded) {
+    staging_handoff_provide(&staging_handoff);
+  }
+  create_bake_pipelines(shader_codes, options.backend);
+
+  if (load_threaded) {
+    pthread_join(load_thread, NULL);
+  }
+
+  // Skybox. Cube inputs already are one, at their own face size.
   cubemap_t skybox_cubemap;
-  cubemap_init_skybox_from_hdr_equirec(
-      &skybox_cubemap,
-      in_path,
-      width,
-      height,
-      "../shaders/out/skybox.vert.spv",
-      "../shaders/out/skybox.frag.spv");
+  if (source.layout == SKYBOX_LAYOUT_EQUIREC) {
+    cubemap_init_skybox_from_hdr_equirec(
+        &skybox_cubemap, &source, width, height);
+  } else {
+    cubemap_init_skybox_from_faces(&skybox_cubemap, &source);
+  }
+  skybox_source_destroy(&source);
   printf("Done rendering skybox\n");
 
   // Irradiance
+  bool project_sh =
+      options.sh_irradiance || options.irradiance_mode == IRRADIANCE_MODE_SH;
+  sh9_t radiance_sh;
+  if (project_sh) {
+    skybox_project_sh9(&skybox_cubemap, &radiance_sh);
+  }
+
   cubemap_t irradiance_cubemap;
-  cubemap_init_irradiance_from_skybox(
-      &irradiance_cubemap,
-      &skybox_cubemap,
-      64,
-      64,
-      "../shaders/out/skybox.vert.spv",
-      "../shaders/out/irradiance.frag.spv");
+  if (options.irradiance_mode == IRRADIANCE_MODE_SH) {
+    cubemap_init_irradiance_from_sh9(
+        &irradiance_cubemap, &radiance_sh, 64, 64);
+  } else {
+    cubemap_init_irradiance_from_skybox(
+        &irradiance_cubemap, &skybox_cubemap, 64, 64);
+  }
   printf("Done rendering irradiance\n");
 
   // Radiance
   uint32_t radiance_dim = 256;
-  uint32_t radiance_mip_count = floor(log2(radiance_dim)) + 1;
+  uint32_t radiance_mip_count = cubemap_full_mip_count(radiance_dim);
   cubemap_t radiance_cubemap;
   cubemap_init_radiance_from_skybox(
       &radiance_cubemap,
       &skybox_cubemap,
       radiance_dim,
       radiance_dim,
-      "../shaders/out/skybox.vert.spv",
-      "../shaders/out/radiance.frag.spv",
-      radiance_mip_count);
+      radiance_mip_count,
+      options.radiance_mode,
+      options.radiance_sample_count,
+      options.radiance_max_error);
   printf("Done rendering radiance with %d mip levels\n", radiance_mip_count);
 
   env_file_write(
-      out_path, &skybox_cubemap, &irradiance_cubemap, &radiance_cubemap);
+      out_path,
+      &skybox_cubemap,
+      &irradiance_cubemap,
+      &radiance_cubemap,
+      options.sh_irradiance ? &radiance_sh : NULL);
 
   printf("Done saving output at %s\n", out_path);
 
@@ -2401,6 +4267,7 @@ int main(int argc, char *argv[]) {
   cubemap_destroy(&radiance_cubemap);
   cubemap_destroy(&skybox_cubemap);
 
+  destroy_bake_pipelines();
   vulkan_teardown();
 
   return 0;
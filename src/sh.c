@@ -0,0 +1,97 @@
+#include "sh.h"
+#include "cube_face.h"
+#include <math.h>
+
+#define SH9_PI 3.14159265358979323846
+
+static void sh9_basis(const float d[3], float basis[SH9_COEFFICIENT_COUNT]) {
+  float x = d[0], y = d[1], z = d[2];
+
+  basis[0] = 0.282094792f;
+  basis[1] = 0.488602512f * y;
+  basis[2] = 0.488602512f * z;
+  basis[3] = 0.488602512f * x;
+  basis[4] = 1.092548431f * x * y;
+  basis[5] = 1.092548431f * y * z;
+  basis[6] = 0.315391565f * (3.0f * z * z - 1.0f);
+  basis[7] = 1.092548431f * x * z;
+  basis[8] = 0.546274215f * (x * x - y * y);
+}
+
+void sh9_project_cubemap(const float *faces, uint32_t face_size, sh9_t *sh) {
+  // Accumulated in doubles so that any face size can be projected without
+  // losing precision, although the baker only passes a level of at most 32
+  // texels a side
+  double sums[SH9_COEFFICIENT_COUNT][3] = {{0}};
+  double weight_sum = 0.0;
+
+  for (uint32_t face = 0; face < CUBE_FACE_COUNT; face++) {
+    for (uint32_t y = 0; y < face_size; y++) {
+      const float *row = faces + ((size_t)face * face_size + y) * face_size * 4;
+
+      for (uint32_t x = 0; x < face_size; x++) {
+        float direction[3];
+        cube_texel_direction(face, face_size, x, y, direction);
+
+        // Solid angle of the texel is proportional to 1 / |direction|^3.
+        // The constant factor cancels out once the weights are normalized
+        // to the whole sphere.
+        float length_squared = direction[0] * direction[0] +
+                               direction[1] * direction[1] +
+                               direction[2] * direction[2];
+        float inv_length = 1.0f / sqrtf(length_squared);
+        float weight = inv_length * inv_length * inv_length;
+
+        direction[0] *= inv_length;
+        direction[1] *= inv_length;
+        direction[2] *= inv_length;
+
+        float basis[SH9_COEFFICIENT_COUNT];
+        sh9_basis(direction, basis);
+
+        const float *texel = &row[x * 4];
+        for (uint32_t i = 0; i < SH9_COEFFICIENT_COUNT; i++) {
+          float w = basis[i] * weight;
+          sums[i][0] += w * texel[0];
+          sums[i][1] += w * texel[1];
+          sums[i][2] += w * texel[2];
+        }
+
+        weight_sum += weight;
+      }
+    }
+  }
+
+  double scale = 4.0 * SH9_PI / weight_sum;
+  for (uint32_t i = 0; i < SH9_COEFFICIENT_COUNT; i++) {
+    for (uint32_t c = 0; c < 3; c++) {
+      sh->coefficients[i][c] = (float)(sums[i][c] * scale);
+    }
+  }
+}
+
+void sh9_radiance_to_irradiance(const sh9_t *radiance, sh9_t *irradiance) {
+  // Clamped cosine convolution factors of each band (pi, 2pi/3 and pi/4,
+  // Ramamoorthi and Hanrahan), divided by pi
+  const float band_factors[3] = {1.0f, 2.0f / 3.0f, 1.0f / 4.0f};
+
+  for (uint32_t i = 0; i < SH9_COEFFICIENT_COUNT; i++) {
+    uint32_t band = i == 0 ? 0 : i < 4 ? 1 : 2;
+    for (uint32_t c = 0; c < 3; c++) {
+      irradiance->coefficients[i][c] =
+          radiance->coefficients[i][c] * band_factors[band];
+    }
+  }
+}
+
+void sh9_evaluate(const sh9_t *sh, const float direction[3], float rgb[3]) {
+  float basis[SH9_COEFFICIENT_COUNT];
+  sh9_basis(direction, basis);
+
+  rgb[0] = rgb[1] = rgb[2] = 0.0f;
+  for (uint32_t i = 0; i < SH9_COEFFICIENT_COUNT; i++) {
+    rgb[0] += basis[i] * sh->coefficients[i][0];
+    rgb[1] += basis[i] * sh->coefficients[i][1];
+    rgb[2] += basis[i] * sh->coefficients[i][2];
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// Order 2 spherical harmonics (9 coefficients per channel) of an
+// environment, used for diffuse irradiance.
+//
+// Coefficients are for the real basis in the usual order: l = 0, then
+// l = 1 for y, z, x, then l = 2 for xy, yz, 3z^2 - 1, xz, x^2 - y^2.
+
+#define SH9_COEFFICIENT_COUNT 9
+
+typedef struct sh9_t {
+  float coefficients[SH9_COEFFICIENT_COUNT][3];
+} sh9_t;
+
+// Projects the radiance of a cubemap onto the basis. faces holds the six
+// face_size x face_size RGBA32F faces one after another, in the layer order
+// of cube_face.h. Texels are weighted by the solid angle they cover.
+void sh9_project_cubemap(const float *faces, uint32_t face_size, sh9_t *sh);
+
+// Convolves radiance with the clamped cosine lobe. Evaluating the result
+// gives irradiance divided by pi, the radiance a white Lambertian surface
+// reflects, which is what the brute force irradiance stage bakes.
+void sh9_radiance_to_irradiance(const sh9_t *radiance, sh9_t *irradiance);
+
+// Evaluates the coefficients in a unit direction
+void sh9_evaluate(const sh9_t *sh, const float direction[3], float rgb[3]);